@@ -0,0 +1,340 @@
+#include "Atlas.hpp"
+#include "utils.hpp"
+#include "stb_image.h"
+#include <algorithm>
+#include <climits>
+
+
+struct PackRect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+static inline bool Contains(const PackRect &a, const PackRect &b)
+{
+    return b.x >= a.x && b.y >= a.y && b.x + b.width <= a.x + a.width && b.y + b.height <= a.y + a.height;
+}
+
+// MaxRects best short side fit, ties on the long side then on the free list order
+static bool FindPosition(const std::vector<PackRect> &freeRects, int width, int height, PackRect &result)
+{
+    int bestShort = INT_MAX;
+    int bestLong = INT_MAX;
+
+    for (size_t i = 0; i < freeRects.size(); i++)
+    {
+        const PackRect &free = freeRects[i];
+        if (free.width < width || free.height < height) continue;
+
+        int leftoverX = free.width - width;
+        int leftoverY = free.height - height;
+        int shortSide = (leftoverX < leftoverY) ? leftoverX : leftoverY;
+        int longSide = (leftoverX < leftoverY) ? leftoverY : leftoverX;
+
+        if (shortSide < bestShort || (shortSide == bestShort && longSide < bestLong))
+        {
+            result.x = free.x;
+            result.y = free.y;
+            result.width = width;
+            result.height = height;
+            bestShort = shortSide;
+            bestLong = longSide;
+        }
+    }
+
+    return bestShort != INT_MAX;
+}
+
+// Cut the used rect out of every free rect it touches (up to 4 maximal pieces each), then drop contained ones
+static void PlaceRect(std::vector<PackRect> &freeRects, const PackRect &used)
+{
+    std::vector<PackRect> pieces;
+
+    for (size_t i = 0; i < freeRects.size();)
+    {
+        PackRect free = freeRects[i];
+        if (used.x >= free.x + free.width || used.x + used.width <= free.x ||
+            used.y >= free.y + free.height || used.y + used.height <= free.y)
+        {
+            i++;
+            continue;
+        }
+
+        if (used.x > free.x)
+        {
+            PackRect piece = { free.x, free.y, used.x - free.x, free.height };
+            pieces.push_back(piece);
+        }
+        if (used.x + used.width < free.x + free.width)
+        {
+            PackRect piece = { used.x + used.width, free.y, free.x + free.width - used.x - used.width, free.height };
+            pieces.push_back(piece);
+        }
+        if (used.y > free.y)
+        {
+            PackRect piece = { free.x, free.y, free.width, used.y - free.y };
+            pieces.push_back(piece);
+        }
+        if (used.y + used.height < free.y + free.height)
+        {
+            PackRect piece = { free.x, used.y + used.height, free.width, free.y + free.height - used.y - used.height };
+            pieces.push_back(piece);
+        }
+
+        freeRects.erase(freeRects.begin() + i);
+    }
+
+    freeRects.insert(freeRects.end(), pieces.begin(), pieces.end());
+
+    for (int i = 0; i < (int)freeRects.size(); i++)
+    {
+        for (int j = i + 1; j < (int)freeRects.size();)
+        {
+            if (Contains(freeRects[i], freeRects[j])) { freeRects.erase(freeRects.begin() + j); continue; }
+            if (Contains(freeRects[j], freeRects[i])) { freeRects.erase(freeRects.begin() + i); i--; break; }
+            j++;
+        }
+    }
+}
+
+
+AtlasBuilder::AtlasBuilder(int maxPageSize, int padding, int extrude)
+{
+    this->maxPageSize = (maxPageSize < ATLAS_INITIAL_PAGE_SIZE) ? ATLAS_INITIAL_PAGE_SIZE : maxPageSize;
+    this->padding = (padding < 0) ? 0 : padding;
+    this->extrude = (extrude < 0) ? 0 : extrude;
+    packed = false;
+}
+
+AtlasBuilder::~AtlasBuilder()
+{
+    Release();
+}
+
+int AtlasBuilder::Add(const char *fileName)
+{
+    unsigned int fileSize = 0;
+    unsigned char *fileData = LoadFileData(fileName, &fileSize);
+    if (fileData == NULL)
+    {
+        Log(2, "[%s] Texture could not be loaded", fileName);
+        return -1;
+    }
+
+    int width = 0, height = 0, comp = 0;
+    unsigned char *pixels = stbi_load_from_memory(fileData, fileSize, &width, &height, &comp, 4);
+    free(fileData);
+    if (pixels == NULL)
+    {
+        Log(2, "[%s] Texture could not be loaded", fileName);
+        return -1;
+    }
+
+    int index = AddPixels(pixels, width, height);
+    stbi_image_free(pixels);
+    if (index < 0) Log(2, "[%s] Texture could not be added to the atlas", fileName);
+    return index;
+}
+
+int AtlasBuilder::AddPixels(const unsigned char *pixels, int width, int height)
+{
+    int border = 2*extrude + padding;
+    if (pixels == NULL || width <= 0 || height <= 0 || width + border > maxPageSize + padding || height + border > maxPageSize + padding)
+    {
+        Log(2, "ATLAS: Image %ix%i does not fit %ix%i pages", width, height, maxPageSize, maxPageSize);
+        return -1;
+    }
+
+    Image image;
+    image.pixels.assign(pixels, pixels + width*height*4);
+    image.width = width;
+    image.height = height;
+    images.push_back(image);
+
+    AtlasSprite sprite = { -1, 0, 0, width, height };
+    sprites.push_back(sprite);
+    packed = false;
+    return (int)sprites.size() - 1;
+}
+
+// NOTE: Extrusion keeps the texel white under linear filtering too
+int AtlasBuilder::AddWhiteTexel()
+{
+    const unsigned char white[4] = { 255, 255, 255, 255 };
+    return AddPixels(white, 1, 1);
+}
+
+bool AtlasBuilder::Pack()
+{
+    if (packed) return true;
+
+    // Tallest first, then widest, then insertion order: same images, same layout
+    std::vector<int> order(images.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b)
+    {
+        if (images[a].height != images[b].height) return images[a].height > images[b].height;
+        return images[a].width > images[b].width;
+    });
+
+    std::vector<Page> previous;
+    previous.swap(pages);
+
+    // Each sprite takes a cell of image + extrusion on both sides + padding on the right/bottom
+    // NOTE: Free space starts padding past the page edge, the last column/row needs no trailing padding
+    std::vector<int> left = order;
+    std::vector<int> rest;
+    std::vector<PackRect> freeRects;
+    int border = 2*extrude + padding;
+
+    while (!left.empty())
+    {
+        int width = ATLAS_INITIAL_PAGE_SIZE;
+        int height = ATLAS_INITIAL_PAGE_SIZE;
+        int page = (int)pages.size();
+
+        for (;;)
+        {
+            freeRects.clear();
+            PackRect all = { 0, 0, width + padding, height + padding };
+            freeRects.push_back(all);
+            rest.clear();
+
+            for (size_t i = 0; i < left.size(); i++)
+            {
+                AtlasSprite &sprite = sprites[left[i]];
+                PackRect cell = { 0, 0, 0, 0 };
+                if (!FindPosition(freeRects, sprite.width + border, sprite.height + border, cell))
+                {
+                    sprite.page = -1;
+                    rest.push_back(left[i]);
+                    continue;
+                }
+
+                PlaceRect(freeRects, cell);
+                sprite.page = page;
+                sprite.x = cell.x + extrude;
+                sprite.y = cell.y + extrude;
+            }
+
+            if (rest.empty() || (width >= maxPageSize && height >= maxPageSize)) break;
+
+            // Grow the page and pack it again from scratch
+            if (width <= height && width < maxPageSize) width *= 2;
+            else height *= 2;
+            if (width > maxPageSize) width = maxPageSize;
+            if (height > maxPageSize) height = maxPageSize;
+        }
+
+        Page info;
+        info.width = width;
+        info.height = height;
+        info.id = (page < (int)previous.size()) ? previous[page].id : 0;
+        pages.push_back(info);
+        left.swap(rest);
+    }
+
+    for (size_t i = pages.size(); i < previous.size(); i++)
+    {
+        if (previous[i].id > 0) UnloadTexture(previous[i].id);
+    }
+
+    packed = true;
+    return true;
+}
+
+bool AtlasBuilder::Build()
+{
+    if (!Pack()) return false;
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    std::vector<unsigned char> pixels;
+    for (size_t p = 0; p < pages.size(); p++)
+    {
+        Page &page = pages[p];
+        pixels.assign(page.width*page.height*4, 0);
+
+        // Copy each image with its edge texels repeated extrude times around it
+        for (size_t i = 0; i < sprites.size(); i++)
+        {
+            const AtlasSprite &sprite = sprites[i];
+            if (sprite.page != (int)p) continue;
+
+            const Image &image = images[i];
+            for (int y = -extrude; y < image.height + extrude; y++)
+            {
+                int sy = (y < 0) ? 0 : ((y >= image.height) ? image.height - 1 : y);
+                const unsigned char *src = &image.pixels[sy*image.width*4];
+                unsigned char *dst = &pixels[((sprite.y + y)*page.width + sprite.x)*4];
+
+                for (int x = -extrude; x < 0; x++) memcpy(dst + x*4, src, 4);
+                memcpy(dst, src, image.width*4);
+                for (int x = image.width; x < image.width + extrude; x++) memcpy(dst + x*4, src + (image.width - 1)*4, 4);
+            }
+        }
+
+        bool created = (page.id == 0);
+        if (created) glGenTextures(1, &page.id);
+        glBindTexture(GL_TEXTURE_2D, page.id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, page.width, page.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+        if (created)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        }
+
+        if (page.id == 0)
+        {
+            Log(2, "ATLAS: Failed to create page %i", (int)p);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            return false;
+        }
+        Log(0, "ATLAS: [ID %i] Page %i built (%ix%i)", page.id, (int)p, page.width, page.height);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+void AtlasBuilder::Release()
+{
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        if (pages[i].id > 0) UnloadTexture(pages[i].id);
+    }
+    pages.clear();
+    images.clear();
+    sprites.clear();
+    packed = false;
+}
+
+bool AtlasBuilder::GetSprite(int index, Texture2D &texture) const
+{
+    if (index < 0 || index >= (int)sprites.size() || sprites[index].page < 0 || pages[sprites[index].page].id == 0)
+    {
+        Log(2, "ATLAS: Sprite %i is not in a built page", index);
+        return false;
+    }
+
+    const AtlasSprite &sprite = sprites[index];
+    const Page &page = pages[sprite.page];
+
+    texture.Release();
+    texture.id = page.id;
+    texture.width = sprite.width;
+    texture.height = sprite.height;
+    texture.format = R8G8B8A8;
+    texture.layer = 0;
+    texture.uvScale.set((float)sprite.width/(float)page.width, (float)sprite.height/(float)page.height);
+    texture.uvOffset.set((float)sprite.x/(float)page.width, (float)sprite.y/(float)page.height);
+    texture.shared = true;
+    return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Batch.hpp"
+
+#define ATLAS_INITIAL_PAGE_SIZE   256     // Pages start this size and double (width first) while sprites are left
+#define ATLAS_MAX_PAGE_SIZE      2048     // Default page size limit, more pages after that
+#define ATLAS_DEFAULT_PADDING       1     // Transparent texels between sprites
+#define ATLAS_DEFAULT_EXTRUDE       1     // Edge texels repeated around each sprite (filtering, subpixel positions)
+
+// Placement of one image in the atlas, in page texels (extrusion excluded)
+struct AtlasSprite
+{
+    int page;               // -1 until packed
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Packs many small R8G8B8A8 images into a few GL_TEXTURE_2D pages, so sprites of one page share a draw call
+// NOTE: MaxRects (best short side fit) over sprites sorted by size, the layout only depends on the images added
+// NOTE: Handles from GetSprite() are Texture2D with uvScale/uvOffset into the page, any DrawTexture*() and
+//       DrawSprites() take them. Source rects stay in image texels, but nothing wraps (no REPEAT) outside the image
+// NOTE: Owns the page textures, copies are not allowed
+struct AtlasBuilder
+{
+    AtlasBuilder(int maxPageSize = ATLAS_MAX_PAGE_SIZE, int padding = ATLAS_DEFAULT_PADDING, int extrude = ATLAS_DEFAULT_EXTRUDE);
+    ~AtlasBuilder();
+
+    int Add(const char *fileName);                                          // Decode with stb_image, returns the sprite index or -1
+    int AddPixels(const unsigned char *pixels, int width, int height);      // R8G8B8A8 pixels, copied
+    int AddWhiteTexel();                                                    // 1x1 white image for RenderBatch::SetShapesTexture(), source (0, 0, 1, 1)
+
+    bool Pack();            // Layout only (no GL), also done by Build()
+    bool Build();           // Pack and upload the pages, existing page textures are reused
+    void Release();         // Pages and images, handles become invalid
+
+    // NOTE: Adding images repacks every page on the next Build(), get the handles again after it
+    bool GetSprite(int index, Texture2D &texture) const;
+    const AtlasSprite &GetPlacement(int index) const { return sprites[index]; }
+    int GetSpriteCount() const { return (int)sprites.size(); }
+    int GetPageCount() const { return (int)pages.size(); }
+    int GetPageWidth(int page) const { return pages[page].width; }
+    int GetPageHeight(int page) const { return pages[page].height; }
+    unsigned int GetPageTexture(int page) const { return pages[page].id; }
+
+private:
+    AtlasBuilder(const AtlasBuilder &) = delete;
+    AtlasBuilder &operator=(const AtlasBuilder &) = delete;
+
+    struct Image
+    {
+        std::vector<unsigned char> pixels;
+        int width;
+        int height;
+    };
+
+    struct Page
+    {
+        int width;
+        int height;
+        unsigned int id;
+    };
+
+    int maxPageSize;
+    int padding;
+    int extrude;
+    bool packed;
+
+    std::vector<Image> images;
+    std::vector<AtlasSprite> sprites;
+    std::vector<Page> pages;
+};
@@ -1,5 +1,10 @@
 #include "Batch.hpp"
 #include "utils.hpp"
+#include "SpriteTransform.hpp"
+#include "SoftRaster.hpp"
+#include "BatchRecorder.hpp"
+#include "StaticBatch.hpp"
+#include <algorithm>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"         // Required for: stbi_load_from_file()
                                             // NOTE: Used to read image data (multiple formats support)
@@ -7,9 +12,15 @@
 
 #define BATCH_BUFFER_ELEMENTS   8192    // Default internal render batch elements limits
 #define BATCH_BUFFERS              1    // Default number of batch buffers (multi-buffering)
-#define BATCH_DRAWCALLS          256    // Default number of batch draw calls (by state changes: mode, texture)
+#define BATCH_DRAWCALLS          256    // Initial draw table size (draws by state changes: mode, texture), grows on demand
 #define MAX_MATRIX_STACK_SIZE             32    // Maximum size of internal Matrix stack
+#define REORDER_GRID_SIZE         64    // Auto reorder grid cells per side
+#define REORDER_MIN_CELL       32.0f    // Smallest auto reorder cell, in world units
+#define REORDER_LARGE_CELLS      256    // Commands covering more cells are scheduled as barriers
  #define SMOOTH_CIRCLE_ERROR_RATE    0.5f
+#define CIRCLE_LOD_MAX_RADIUS       2048    // Screen radius (pixels) of the cached segment counts, larger ones are computed
+#define CIRCLE_TABLE_MAX_SEGMENTS   1024    // Full circle unit tables cached up to this segment count
+#define CIRCLE_GRADIENT_SEGMENTS      36    // Fixed tessellation of gradient circles, circle outlines and ellipses
 
 const Color Color::Black(0, 0, 0, 255);
 const Color Color::White(255, 255, 255, 255);
@@ -232,33 +243,287 @@ unsigned int LoadTexture(const void *data, int width, int height, PixelFormat fo
 }
 
 
+// Vertex layouts
+//------------------------------------------------------------------------------------------------
+int GetLayoutStride(VertexLayout layout)
+{
+    switch (layout)
+    {
+        case VERTEX_LAYOUT_2D: return sizeof(Vertex2D);
+        case VERTEX_LAYOUT_2D_HALF: return sizeof(Vertex2DHalf);
+        case VERTEX_LAYOUT_2D_SHORT: return sizeof(Vertex2DShort);
+        default: break;
+    }
+    return sizeof(Vertex);
+}
+
+// Vertex attribute pointers for the bound VBO (locations: 0 position, 1 texcoord, 2 color, 3 layer + slot)
+static void SetVertexAttributes(VertexLayout layout)
+{
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    switch (layout)
+    {
+        case VERTEX_LAYOUT_2D:
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex2D), reinterpret_cast<void*>(offsetof(Vertex2D, x)));
+            glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex2D), reinterpret_cast<void*>(offsetof(Vertex2D, u)));
+            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex2D), reinterpret_cast<void*>(offsetof(Vertex2D, color)));
+            break;
+        case VERTEX_LAYOUT_2D_HALF:
+            glVertexAttribPointer(0, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(Vertex2DHalf), reinterpret_cast<void*>(offsetof(Vertex2DHalf, x)));
+            glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex2DHalf), reinterpret_cast<void*>(offsetof(Vertex2DHalf, u)));
+            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex2DHalf), reinterpret_cast<void*>(offsetof(Vertex2DHalf, color)));
+            break;
+        case VERTEX_LAYOUT_2D_SHORT:
+            glVertexAttribPointer(0, 2, GL_SHORT, GL_FALSE, sizeof(Vertex2DShort), reinterpret_cast<void*>(offsetof(Vertex2DShort, x)));
+            glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex2DShort), reinterpret_cast<void*>(offsetof(Vertex2DShort, u)));
+            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex2DShort), reinterpret_cast<void*>(offsetof(Vertex2DShort, color)));
+            break;
+        default:
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, position)));
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, texcoord)));
+            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, color)));
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, layer)));
+            break;
+    }
+}
+
+// Float to IEEE half, round to nearest (no NaN payloads, positions are finite)
+static inline unsigned short FloatToHalf(float value)
+{
+    unsigned int f;
+    memcpy(&f, &value, sizeof(f));
+
+    unsigned int sign = (f >> 16) & 0x8000;
+    int exponent = (int)((f >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = f & 0x7fffff;
+
+    if (exponent >= 31) return (unsigned short)(sign | 0x7c00);     // Overflow to infinity
+    if (exponent <= 0)
+    {
+        if (exponent < -10) return (unsigned short)sign;            // Underflow to zero
+        mantissa |= 0x800000;
+        unsigned int shift = (unsigned int)(14 - exponent);
+        unsigned int half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+        return (unsigned short)(sign | half);
+    }
+
+    unsigned int half = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;                                  // Carry into exponent is correct rounding
+    return (unsigned short)half;
+}
+
+static inline unsigned short PackUnorm16(float value)
+{
+    if (value <= 0.0f) return 0;
+    if (value >= 1.0f) return 65535;
+    return (unsigned short)(value*65535.0f + 0.5f);
+}
+
+static inline short PackShort(float value)
+{
+    if (value <= -32768.0f) return -32768;
+    if (value >= 32767.0f) return 32767;
+    return (short)floorf(value + 0.5f);
+}
+
+// Write one vertex at dst in the given layout
+static inline void WriteVertex(VertexLayout layout, unsigned char *dst, float x, float y, float z, float u, float v,
+                               unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+    switch (layout)
+    {
+        case VERTEX_LAYOUT_2D:
+        {
+            Vertex2D *vertex = (Vertex2D *)dst;
+            vertex->x = x;
+            vertex->y = y;
+            vertex->u = PackUnorm16(u);
+            vertex->v = PackUnorm16(v);
+            vertex->color.set(r, g, b, a);
+        } break;
+        case VERTEX_LAYOUT_2D_HALF:
+        {
+            Vertex2DHalf *vertex = (Vertex2DHalf *)dst;
+            vertex->x = FloatToHalf(x);
+            vertex->y = FloatToHalf(y);
+            vertex->u = PackUnorm16(u);
+            vertex->v = PackUnorm16(v);
+            vertex->color.set(r, g, b, a);
+        } break;
+        case VERTEX_LAYOUT_2D_SHORT:
+        {
+            Vertex2DShort *vertex = (Vertex2DShort *)dst;
+            vertex->x = PackShort(x);
+            vertex->y = PackShort(y);
+            vertex->u = PackUnorm16(u);
+            vertex->v = PackUnorm16(v);
+            vertex->color.set(r, g, b, a);
+        } break;
+        default:
+        {
+            Vertex *vertex = (Vertex *)dst;
+            vertex->position.set(x, y, z);
+            vertex->texcoord.set(u, v);
+            vertex->color.set(r, g, b, a);
+            vertex->layer = 0;
+            vertex->slot = 0;
+        } break;
+    }
+}
+
+void PackVertex(VertexLayout layout, unsigned char *dst, const Vertex &vertex)
+{
+    if (layout == VERTEX_LAYOUT_DEFAULT)
+    {
+        memcpy(dst, &vertex, sizeof(Vertex));
+        return;
+    }
+    WriteVertex(layout, dst, vertex.position.x, vertex.position.y, vertex.position.z, vertex.texcoord.x, vertex.texcoord.y,
+                vertex.color.r, vertex.color.g, vertex.color.b, vertex.color.a);
+}
+
+// Fill a Reserve() span vertex and advance
+static inline void PutVertex(Vertex *&vertex, float x, float y, float z, float u, float v, const Color &color, unsigned int layer = 0)
+{
+    vertex->position.set(x, y, z);
+    vertex->texcoord.set(u, v);
+    vertex->color = color;
+    vertex->layer = layer;
+    vertex->slot = 0;
+    vertex++;
+}
+
+// Untextured shapes, any texcoord hits the 1x1 default texture
+static inline void PutVertex(Vertex *&vertex, float x, float y, float z, const Color &color)
+{
+    PutVertex(vertex, x, y, z, 0.0f, 0.0f, color);
+}
+
+// Per-instance attribute pointers, offset to the first instance of a draw
+// NOTE: GLES 3.0 has no base instance, so SPRITES draws re-point the attributes instead
+static void SetInstanceAttributes(size_t firstInstance)
+{
+    size_t base = firstInstance*sizeof(QuadInstance);
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), reinterpret_cast<void*>(base + offsetof(QuadInstance, x)));
+    glVertexAttribDivisor(1, 1);
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), reinterpret_cast<void*>(base + offsetof(QuadInstance, originX)));
+    glVertexAttribDivisor(2, 1);
+
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), reinterpret_cast<void*>(base + offsetof(QuadInstance, u0)));
+    glVertexAttribDivisor(3, 1);
+
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(QuadInstance), reinterpret_cast<void*>(base + offsetof(QuadInstance, color)));
+    glVertexAttribDivisor(4, 1);
+}
+
 // Render batch management
 //------------------------------------------------------------------------------------------------
 RenderBatch::RenderBatch()
 {
-    
+    instancing = false;
+    instanceCounter = 0;
+    instanceShaderId = 0;
+    arrayShaderId = 0;
+    multiShaderId = 0;
+    textureSlots = 1;
+    maxTextureSlots = 1;
+    textureSlot = 0;
+    flushReason = FLUSH_RENDER;
+    memset(&frameStats, 0, sizeof(RenderStats));
+    memset(&totalStats, 0, sizeof(RenderStats));
+    breakTracking = false;
+    breakLabel = NULL;
+    uploadMode = UPLOAD_SUBDATA;
+    vertexLayout = VERTEX_LAYOUT_DEFAULT;
+    quadStrips = false;
+    reservedCount = 0;
+    reserveStaged = false;
+    sdfSpan = false;
+    vertexStride = sizeof(Vertex);
+    mapped = false;
+    vertexData = NULL;
+    instanceData = NULL;
+    deferred = false;
+    autoReorder = false;
+    replaying = false;
+    currentLayer = 0;
+    shapesTextureId = 0;
+    shapesU = 0.0f;
+    shapesV = 0.0f;
+    shapesSpan = false;
+    rasterizer = NULL;
+    capture = NULL;
+    captureSegments = 0;
+    captureUploadMode = UPLOAD_SUBDATA;
+    transformRequired = false;
+    transformConformal = true;
+    culling = true;
+    cullAuto = true;
+    cullActive = false;
+    for (int i = 0; i < 4; i++) cullBounds[i] = 0.0f;
+    viewportWidth = 0;
+    viewportHeight = 0;
+    lodScale = 1.0f;
+    shapeSdf = true;
 }
-void RenderBatch::Init(int numBuffers, int bufferElements)
+void RenderBatch::Init(int numBuffers, int bufferElements, VertexLayout layout)
 {
 
-    
+    vertexLayout = layout;
+    vertexStride = GetLayoutStride(layout);
 
 const char *defaultVShaderCode =
     "#version 320 es                       \n"
      "precision mediump float;           \n"
-    "in vec3 vertexPosition;            \n"
-    "in vec2 vertexTexCoord;            \n"
-    "in vec4 vertexColor;               \n"
-    "out vec2 fragTexCoord;             \n"
+    "layout(location = 0) in vec3 vertexPosition; \n"
+    "layout(location = 1) in vec2 vertexTexCoord; \n"
+    "layout(location = 2) in vec4 vertexColor;    \n"
+    "layout(location = 3) in highp vec2 vertexTexIndex; \n"     // layer, slot
+    "out highp vec2 fragTexCoord;       \n"
     "out vec4 fragColor;                \n"
+    "flat out highp float fragLayer;    \n"
+    "flat out highp float fragSlot;     \n"
     "uniform mat4 mvp;                  \n"
     "void main()                        \n"
     "{                                  \n"
     "    fragTexCoord = vertexTexCoord; \n"
     "    fragColor = vertexColor;       \n"
+    "    fragLayer = vertexTexIndex.x;  \n"
+    "    fragSlot = vertexTexIndex.y;   \n"
     "    gl_Position = mvp*vec4(vertexPosition, 1.0); \n"
     "}                                  \n";
 
+    // Packed 2D layouts: no depth component, attribute conversion done by the vertex fetch
+    // NOTE: No layer either, texture arrays sample their first layer
+    const char *packedVShaderCode =
+    "#version 320 es                       \n"
+     "precision mediump float;           \n"
+    "layout(location = 0) in vec2 vertexPosition; \n"
+    "layout(location = 1) in vec2 vertexTexCoord; \n"
+    "layout(location = 2) in vec4 vertexColor;    \n"
+    "out vec2 fragTexCoord;             \n"
+    "out vec4 fragColor;                \n"
+    "flat out highp float fragLayer;    \n"
+    "uniform mat4 mvp;                  \n"
+    "void main()                        \n"
+    "{                                  \n"
+    "    fragTexCoord = vertexTexCoord; \n"
+    "    fragColor = vertexColor;       \n"
+    "    fragLayer = 0.0;               \n"
+    "    gl_Position = mvp*vec4(vertexPosition, 0.0, 1.0); \n"
+    "}                                  \n";
+
 
     const char *defaultFShaderCode =
     "#version 320 es      \n"
@@ -273,11 +538,65 @@ const char *defaultVShaderCode =
     "    finalColor = texelColor*fragColor;        \n"
     "}                                  \n";
 
+    // SDF shapes (slot >= SHAPE_SDF_BIT): fragTexCoord is the position in the shape, coverage from its distance in pixels
+    // NOTE: Arcs have outer radius 1, A the inner radius, B the half aperture around +x (1: full turn). Rounded rects
+    //       have a long half size of 1 along x, B the short half size, A the corner radius. Same math as SoftRasterizer
+    const char *shapeFunctionCode =
+    "float ShapeCoverage()              \n"
+    "{                                  \n"
+    "    int shape = int(fragSlot);     \n"
+    "    highp vec2 p = fragTexCoord;   \n"
+    "    highp float a = float(shape & 4095)/4095.0; \n"
+    "    highp float b = fragLayer/65535.0;          \n"
+    "    highp float len = length(p);   \n"
+    "    highp float unit = 0.5*(length(dFdx(p)) + length(dFdy(p))); \n"     // Shape units per pixel
+    "    highp float slope = max(length(vec2(dFdx(len), dFdy(len))), 1e-6); \n"
+    "    highp float d;                 \n"
+    "    if ((shape & 8192) != 0)       \n"
+    "    {                              \n"
+    "        highp vec2 q = abs(p) - vec2(1.0 - a, b - a); \n"
+    "        d = (length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - a)/unit; \n"
+    "    }                              \n"
+    "    else                           \n"
+    "    {                              \n"
+    "        d = (len - 1.0)/slope;     \n"     // Outer edge, also right for ellipses
+    "        if (a > 0.0) d = max(d, (a - len)/unit); \n"
+    "        if (b < 1.0)               \n"
+    "        {                          \n"
+    "            highp vec2 c = vec2(cos(b*3.14159265), sin(b*3.14159265)); \n"
+    "            highp vec2 m = vec2(p.x, abs(p.y)); \n"
+    "            d = max(d, length(m - c*max(dot(m, c), 0.0))*sign(c.x*m.y - c.y*m.x)/unit); \n"
+    "        }                          \n"
+    "    }                              \n"
+    "    if ((shape & 16384) != 0) return clamp(1.0 - abs(d), 0.0, 1.0); \n"
+    "    return clamp(0.5 - d, 0.0, 1.0);           \n"
+    "}                                  \n";
+
+    std::string shapeFShaderCode = std::string(
+    "#version 320 es      \n"
+    "precision mediump float;           \n"
+    "in highp vec2 fragTexCoord;        \n"
+    "in vec4 fragColor;                 \n"
+    "flat in highp float fragLayer;     \n"
+    "flat in highp float fragSlot;      \n"
+    "out vec4 finalColor;               \n"
+    "uniform sampler2D texture0;        \n") + shapeFunctionCode +
+    "void main()                        \n"
+    "{                                  \n"
+    "    if (fragSlot >= 32768.0)       \n"
+    "    {                              \n"
+    "        finalColor = vec4(fragColor.rgb, fragColor.a*ShapeCoverage()); \n"
+    "        return;                    \n"
+    "    }                              \n"
+    "    vec4 texelColor = texture(texture0, fragTexCoord);   \n"
+    "    finalColor = texelColor*fragColor;        \n"
+    "}                                  \n";
+
     unsigned int vShaderId = 0;
     unsigned int fShaderId = 0;
 
-    vShaderId = CompileShader(defaultVShaderCode, GL_VERTEX_SHADER);
-    fShaderId = CompileShader(defaultFShaderCode, GL_FRAGMENT_SHADER);
+    vShaderId = CompileShader((vertexLayout == VERTEX_LAYOUT_DEFAULT) ? defaultVShaderCode : packedVShaderCode, GL_VERTEX_SHADER);
+    fShaderId = CompileShader((vertexLayout == VERTEX_LAYOUT_DEFAULT) ? shapeFShaderCode.c_str() : defaultFShaderCode, GL_FRAGMENT_SHADER);
     if (vShaderId != 0 && fShaderId != 0)
     {
         defaultShaderId = LoadShaderProgram(vShaderId, fShaderId);
@@ -297,7 +616,139 @@ const char *defaultVShaderCode =
     mpvId = glGetUniformLocation(defaultShaderId, "mvp");
     textId = glGetUniformLocation(defaultShaderId, "texture0");
 
+    // Same vertex stage, texture fetched from a GL_TEXTURE_2D_ARRAY layer
+    const char *arrayFShaderCode =
+    "#version 320 es      \n"
+    "precision mediump float;           \n"
+    "in vec2 fragTexCoord;              \n"
+    "in vec4 fragColor;                 \n"
+    "flat in highp float fragLayer;     \n"
+    "out vec4 finalColor;               \n"
+    "uniform mediump sampler2DArray texture0; \n"
+    "void main()                        \n"
+    "{                                  \n"
+    "    vec4 texelColor = texture(texture0, vec3(fragTexCoord, fragLayer));   \n"
+    "    finalColor = texelColor*fragColor;        \n"
+    "}                                  \n";
+
+    vShaderId = CompileShader((vertexLayout == VERTEX_LAYOUT_DEFAULT) ? defaultVShaderCode : packedVShaderCode, GL_VERTEX_SHADER);
+    fShaderId = CompileShader(arrayFShaderCode, GL_FRAGMENT_SHADER);
+    arrayShaderId = 0;
+    if (vShaderId != 0 && fShaderId != 0)
+    {
+        arrayShaderId = LoadShaderProgram(vShaderId, fShaderId);
+        glDeleteShader(vShaderId);
+        glDeleteShader(fShaderId);
+    }
+    if (arrayShaderId != 0) Log(0, "SHADER: [ID %i] Texture array shader loaded successfully", arrayShaderId);
+    else Log(1, "SHADER: Failed to load texture array shader, TextureArray layers will not draw");
+
+    arrayMpvId = glGetUniformLocation(arrayShaderId, "mvp");
+    arrayTextId = glGetUniformLocation(arrayShaderId, "texture0");
+
+    // Texture table: one sampler per unit, picked by the vertex slot
+    // NOTE: Sampler arrays only take dynamically uniform indices, a per-vertex slot needs constant ones
+    int maxUnits = 1;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxUnits);
+    maxTextureSlots = (maxUnits < BATCH_MAX_TEXTURE_SLOTS) ? maxUnits : BATCH_MAX_TEXTURE_SLOTS;
+    multiShaderId = 0;
+    if (vertexLayout == VERTEX_LAYOUT_DEFAULT && maxTextureSlots > 1)
+    {
+        std::string multiFShaderCode =
+        "#version 320 es      \n"
+        "precision mediump float;           \n"
+        "in highp vec2 fragTexCoord;        \n"
+        "in vec4 fragColor;                 \n"
+        "flat in highp float fragLayer;     \n"
+        "flat in highp float fragSlot;      \n"
+        "out vec4 finalColor;               \n"
+        "uniform sampler2D textures[" + std::to_string(maxTextureSlots) + "]; \n" + shapeFunctionCode +
+        "void main()                        \n"
+        "{                                  \n"
+        "    if (fragSlot >= 32768.0)       \n"
+        "    {                              \n"
+        "        finalColor = vec4(fragColor.rgb, fragColor.a*ShapeCoverage()); \n"
+        "        return;                    \n"
+        "    }                              \n"
+        "    int slot = int(fragSlot);      \n"
+        "    vec4 texelColor;               \n";
+        for (int i = 0; i < maxTextureSlots; i++)
+        {
+            std::string index = std::to_string(i);
+            if (i == 0) multiFShaderCode += "    if (slot == 0) texelColor = texture(textures[0], fragTexCoord); \n";
+            else if (i < maxTextureSlots - 1) multiFShaderCode += "    else if (slot == " + index + ") texelColor = texture(textures[" + index + "], fragTexCoord); \n";
+            else multiFShaderCode += "    else texelColor = texture(textures[" + index + "], fragTexCoord); \n";
+        }
+        multiFShaderCode +=
+        "    finalColor = texelColor*fragColor;        \n"
+        "}                                  \n";
+
+        vShaderId = CompileShader(defaultVShaderCode, GL_VERTEX_SHADER);
+        fShaderId = CompileShader(multiFShaderCode.c_str(), GL_FRAGMENT_SHADER);
+        if (vShaderId != 0 && fShaderId != 0)
+        {
+            multiShaderId = LoadShaderProgram(vShaderId, fShaderId);
+            glDeleteShader(vShaderId);
+            glDeleteShader(fShaderId);
+        }
+    }
+    if (multiShaderId != 0)
+    {
+        int units[BATCH_MAX_TEXTURE_SLOTS];
+        for (int i = 0; i < maxTextureSlots; i++) units[i] = i;
+        glUseProgram(multiShaderId);
+        glUniform1iv(glGetUniformLocation(multiShaderId, "textures"), maxTextureSlots, units);
+        glUseProgram(defaultShaderId);
+        multiMpvId = glGetUniformLocation(multiShaderId, "mvp");
+        Log(0, "SHADER: [ID %i] Multi-texture shader loaded successfully (%i slots)", multiShaderId, maxTextureSlots);
+    }
+    else
+    {
+        maxTextureSlots = 1;
+        textureSlots = 1;
+    }
+
+    // Instanced sprites: each QuadInstance is expanded from a static unit quad
+    const char *instanceVShaderCode =
+    "#version 320 es                       \n"
+    "precision mediump float;           \n"
+    "layout(location = 0) in vec2 vertexCorner;   \n"
+    "layout(location = 1) in vec4 instanceRect;   \n"     // x, y, width, height
+    "layout(location = 2) in vec3 instanceOrigin; \n"     // originX, originY, rotation
+    "layout(location = 3) in vec4 instanceSource; \n"     // u0, v0, u1, v1
+    "layout(location = 4) in vec4 instanceColor;  \n"
+    "out vec2 fragTexCoord;             \n"
+    "out vec4 fragColor;                \n"
+    "uniform mat4 mvp;                  \n"
+    "void main()                        \n"
+    "{                                  \n"
+    "    vec2 local = vertexCorner*instanceRect.zw - instanceOrigin.xy; \n"
+    "    float s = sin(instanceOrigin.z);   \n"
+    "    float c = cos(instanceOrigin.z);   \n"
+    "    vec2 position = instanceRect.xy + vec2(local.x*c - local.y*s, local.x*s + local.y*c); \n"
+    "    fragTexCoord = mix(instanceSource.xy, instanceSource.zw, vertexCorner); \n"
+    "    fragColor = instanceColor;     \n"
+    "    gl_Position = mvp*vec4(position, 0.0, 1.0); \n"
+    "}                                  \n";
+
+    vShaderId = CompileShader(instanceVShaderCode, GL_VERTEX_SHADER);
+    fShaderId = CompileShader(defaultFShaderCode, GL_FRAGMENT_SHADER);
+    instanceShaderId = 0;
+    if (vShaderId != 0 && fShaderId != 0)
+    {
+        instanceShaderId = LoadShaderProgram(vShaderId, fShaderId);
+        glDeleteShader(vShaderId);
+        glDeleteShader(fShaderId);
+    }
+    if (instanceShaderId != 0) Log(0, "SHADER: [ID %i] Instanced sprite shader loaded successfully", instanceShaderId);
+    else Log(1, "SHADER: Failed to load instanced sprite shader, SPRITES mode disabled");
+
+    instanceMpvId = glGetUniformLocation(instanceShaderId, "mvp");
+    instanceTextId = glGetUniformLocation(instanceShaderId, "texture0");
+
     matrix.Ortho(0, 800, 600, 0, -0.1f, 1.0f);
+    UpdateCullBounds();
+    UpdateLodScale();
 
     GLfloat mat[16]=
             { matrix.m0, matrix.m1, matrix.m2, matrix.m3,
@@ -315,73 +766,64 @@ const char *defaultVShaderCode =
 
 
 
-    for (int i=0;i<numBuffers;i++)
-    {
-        vertexBuffer.push_back(new VertexBuffer());
-        
-    }
+    vertexBuffer.resize(numBuffers);
 
       vertexCounter = 0;
+      instanceCounter = 0;
       currentBuffer = 0;
     
 
     for (int i = 0; i < numBuffers; i++)
     {
-        vertexBuffer[i]->elementCount = bufferElements;
-
-        int k = 0;
-
-
-        for (int j = 0; j <= bufferElements; j ++)
-        {
-            
-            vertexBuffer[i]->vertices.push_back(Vertex());
-            vertexBuffer[i]->vertices.push_back(Vertex());
-            vertexBuffer[i]->vertices.push_back(Vertex());
-            vertexBuffer[i]->vertices.push_back(Vertex());
-          
+        vertexBuffer[i].elementCount = bufferElements;
+        vertexBuffer[i].vertices.resize((bufferElements + 1)*4*vertexStride);
+    }
 
-            
+    // One immutable quad index buffer shared by every vertex buffer
+    quadIndexCount = bufferElements;
+    glGenBuffers(1, &quadIboId);
+    LoadQuadIndices();
 
+  
+    for (int i = 0; i <numBuffers; i++)
+    {
+        glGenVertexArrays(1,&vertexBuffer[i].vaoId);
+        glBindVertexArray(vertexBuffer[i].vaoId);
 
-            vertexBuffer[i]->indices.push_back(k);
-            vertexBuffer[i]->indices.push_back(k + 1);
-            vertexBuffer[i]->indices.push_back(k + 2);
-            vertexBuffer[i]->indices.push_back(k);
-            vertexBuffer[i]->indices.push_back(k + 2);
-            vertexBuffer[i]->indices.push_back(k + 3);
-            
+        glGenBuffers(1, &vertexBuffer[i].vboId);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i].vboId);
+        glBufferData(GL_ARRAY_BUFFER, vertexBuffer[i].vertices.size(), vertexBuffer[i].vertices.data(), GL_DYNAMIC_DRAW);
 
-            k+=4;
-        }
+        SetVertexAttributes(vertexLayout);
 
-      
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIboId);
     }
 
-  
-    for (int i = 0; i <numBuffers; i++)
+    // Unit quad corners in QUADS order (top-left, bottom-left, bottom-right, top-right)
+    // NOTE: Indexed with the first quad of the shared quad index buffer
+    const float corners[8] = { 0.0f, 0.0f,  0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f };
+    glGenBuffers(1, &quadVboId);
+    glBindBuffer(GL_ARRAY_BUFFER, quadVboId);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+    for (int i = 0; i < numBuffers; i++)
     {
-        glGenVertexArrays(1,&vertexBuffer[i]->vaoId);
-        glBindVertexArray(vertexBuffer[i]->vaoId);
+        vertexBuffer[i].instances.resize(bufferElements);
 
-        glGenBuffers(1, &vertexBuffer[i]->vboId);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId);
-        glBufferData(GL_ARRAY_BUFFER, vertexBuffer[i]->vertices.size()*sizeof(Vertex), vertexBuffer[i]->vertices.data(), GL_DYNAMIC_DRAW);
+        glGenVertexArrays(1, &vertexBuffer[i].instanceVaoId);
+        glBindVertexArray(vertexBuffer[i].instanceVaoId);
 
+        glBindBuffer(GL_ARRAY_BUFFER, quadVboId);
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, position)));
-
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, texcoord)));
-
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, color)));
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), 0);
 
+        glGenBuffers(1, &vertexBuffer[i].instanceVboId);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i].instanceVboId);
+        glBufferData(GL_ARRAY_BUFFER, vertexBuffer[i].instances.size()*sizeof(QuadInstance), NULL, GL_DYNAMIC_DRAW);
+        SetInstanceAttributes(0);
 
-
-        glGenBuffers(1, &vertexBuffer[i]->iboId);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexBuffer[i]->iboId);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER,  vertexBuffer[i]->indices.size() * sizeof(unsigned int), vertexBuffer[i]->indices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIboId);
+        vertexBuffer[i].fence = 0;
     }
 
 
@@ -392,18 +834,23 @@ const char *defaultVShaderCode =
 
 
 
+    draws.resize(BATCH_DRAWCALLS);
     for (int i = 0; i < BATCH_DRAWCALLS; i++)
     {
-        draws.push_back(new DrawCall());
-        draws[i]->mode = QUADS;
-        draws[i]->vertexCount = 0;
-        draws[i]->vertexAlignment = 0;
-        draws[i]->textureId =defaultTextureId;
+        draws[i].mode = QUADS;
+        draws[i].vertexCount = 0;
+        draws[i].vertexAlignment = 0;
+        draws[i].textureId =defaultTextureId;
+        draws[i].textureCount = 0;
     }
 
     bufferCount = numBuffers;    // Record buffer count
     drawCounter = 1;             // Reset draws counter
     currentDepth = -1.0f;         // Reset depth value
+
+    vertexData = vertexBuffer[currentBuffer].vertices.data();
+    instanceData = vertexBuffer[currentBuffer].instances.data();
+    if (uploadMode == UPLOAD_MAPPED) MapBuffers();
     
 }
 
@@ -429,25 +876,29 @@ void UnloadTexture(unsigned int id)
 void RenderBatch::Release()
 {
     if (vertexBuffer.size() == 0) return;
+    UnmapBuffers();
     for (int i = 0; i < (int)vertexBuffer.size(); i++)
     {
-        UnloadVertexBuffer(vertexBuffer[i]->vboId);
-        UnloadVertexBuffer(vertexBuffer[i]->iboId);
-        UnloadVertexArray(vertexBuffer[i]->vaoId);
-    }
-    for (int i = 0; i < (int)draws.size(); i++)
-    {
-        SAFE_DELETE(draws[i]);
-    }
-    for (int i = 0; i < (int)vertexBuffer.size(); i++)
-    {
-        vertexBuffer[i]->vertices.clear();
-        vertexBuffer[i]->indices.clear();
-        SAFE_DELETE(vertexBuffer[i]);
+        if (vertexBuffer[i].fence != 0) glDeleteSync(vertexBuffer[i].fence);
+        UnloadVertexBuffer(vertexBuffer[i].vboId);
+        UnloadVertexArray(vertexBuffer[i].vaoId);
+        UnloadVertexBuffer(vertexBuffer[i].instanceVboId);
+        UnloadVertexArray(vertexBuffer[i].instanceVaoId);
     }
+    UnloadVertexBuffer(quadVboId);
+    UnloadVertexBuffer(quadIboId);
+    draws.clear();
     vertexBuffer.clear();
+    deferredCommands.clear();
+    deferredKeys.clear();
+    deferredVertices.clear();
+    deferredInstances.clear();
+    deferredTextures.clear();
     UnloadTexture(defaultTextureId);
     glDeleteProgram(defaultShaderId);
+    if (instanceShaderId != 0) glDeleteProgram(instanceShaderId);
+    if (arrayShaderId != 0) glDeleteProgram(arrayShaderId);
+    if (multiShaderId != 0) glDeleteProgram(multiShaderId);
     Log(0, "Render batch vertex buffers unloaded successfully from VRAM (GPU)");
 }
 
@@ -458,182 +909,807 @@ RenderBatch::~RenderBatch()
 
 void RenderBatch::Render()
 {
-        if (vertexCounter > 0)
-        {
-            glBindVertexArray(vertexBuffer[currentBuffer]->vaoId);
-            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCounter * sizeof(Vertex), vertexBuffer[currentBuffer]->vertices.data());
-            glBindVertexArray(0);
-        }
-        if (vertexCounter > 0)
-        {
+        BATCH_STAT(FlushReason reason = flushReason);
+        flushReason = FLUSH_RENDER;
 
-            glUseProgram(defaultShaderId);
-            GLfloat mat[16]=
-            {
-                    matrix.m0, matrix.m1, matrix.m2, matrix.m3,
-                    matrix.m4, matrix.m5, matrix.m6, matrix.m7,
-                    matrix.m8, matrix.m9, matrix.m10, matrix.m11,
-                    matrix.m12, matrix.m13, matrix.m14, matrix.m15
-            };
+        ReplayDeferred();
 
+        // Capturing: the buffer goes into the static batch instead of the screen
+        if (capture != NULL)
+        {
+            CaptureStatic();
+            ResetDraws();
+            return;
+        }
 
-            glUniformMatrix4fv(mpvId, 1, false, mat);
-            glUniform1i(textId, 0);
-            
-            glBindVertexArray(vertexBuffer[currentBuffer]->vaoId);
-            
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexBuffer[currentBuffer]->iboId);
+        if (vertexCounter > 0 || instanceCounter > 0)
+        {
+            BATCH_STAT(CountFlush(reason));
+            BATCH_STAT(frameStats.uploadBytes += (unsigned long long)vertexCounter*vertexStride + (unsigned long long)instanceCounter*sizeof(QuadInstance));
+        }
 
-            glActiveTexture(GL_TEXTURE0);
+        if (rasterizer != NULL)
+        {
+            SubmitRaster();
+            ResetDraws();
+            return;
+        }
 
-         //   Log(0,"draw counter %d vertex %d %d ",drawCounter,vertexCounter, draws[0]->vertexCount/4*6);   
+        // A region whose map failed was written to the CPU copies, it is uploaded like UPLOAD_SUBDATA
+        bool wasMapped = mapped;
+        if (mapped)
+        {
+            UnmapBuffers();
+        }
+        else if (vertexCounter > 0)
+        {
+            glBindVertexArray(vertexBuffer[currentBuffer].vaoId);
+            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer].vboId);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCounter * vertexStride, vertexBuffer[currentBuffer].vertices.data());
+            glBindVertexArray(0);
+        }
+        if (instanceCounter > 0 && !wasMapped)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer].instanceVboId);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, instanceCounter * sizeof(QuadInstance), vertexBuffer[currentBuffer].instances.data());
+        }
+        if (vertexCounter > 0 || instanceCounter > 0)
+        {
+            DrawList(draws.data(), drawCounter, vertexBuffer[currentBuffer], instanceCounter > 0, matrix);
 
-            for (int i = 0, vertexOffset = 0; i < drawCounter; i++)
+            // Guard the region until the GPU has consumed it, checked before it is mapped again
+            if (uploadMode == UPLOAD_MAPPED)
             {
-
-                glBindTexture(GL_TEXTURE_2D, draws[i]->textureId);
-
-                int mode =GL_LINES;
-                if (draws[i]->mode == LINES) mode = GL_LINES;
-                else if (draws[i]->mode == TRIANGLES) mode = GL_TRIANGLES;
-                else if (draws[i]->mode == QUADS) mode = GL_TRIANGLES;
-             
-
-               if ((draws[i]->mode == LINES) || (draws[i]->mode == TRIANGLES)) glDrawArrays(mode, vertexOffset, draws[i]->vertexCount);
-               else
-               {
-                      glDrawElements(GL_TRIANGLES, draws[i]->vertexCount/4*6, GL_UNSIGNED_INT,(GLvoid *)(vertexOffset/4*6*sizeof(unsigned int)));
-               }
-
-               vertexOffset += (draws[i]->vertexCount + draws[i]->vertexAlignment);
+                if (vertexBuffer[currentBuffer].fence != 0) glDeleteSync(vertexBuffer[currentBuffer].fence);
+                vertexBuffer[currentBuffer].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
             }
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-            glBindTexture(GL_TEXTURE_2D, 0);    // Unbind textures
         }
 
     glBindVertexArray(0); // Unbind VAO
     glUseProgram(0);    // Unbind shader program
-    vertexCounter = 0;
-    currentDepth = -1.0f;
-    for (int i = 0; i < BATCH_DRAWCALLS; i++)
-    {
-        draws[i]->mode =QUADS;
-        draws[i]->vertexCount = 0;
-        draws[i]->textureId = defaultTextureId;
-    }
-    drawCounter = 1;
-    currentBuffer++;
-    if (currentBuffer >= bufferCount) currentBuffer = 0;
-
+    ResetDraws();
 }
 
-bool RenderBatch::CheckRenderBatchLimit(int vCount)
+// Draw a draw list from buffer (uploaded), instances: list has SPRITES draws
+void RenderBatch::DrawList(const DrawCall *list, int count, const VertexBuffer &buffer, bool instances, const Matrix &mvp)
 {
-    bool overflow = false;
-
+    GLfloat mat[16]=
+    {
+        mvp.m0, mvp.m1, mvp.m2, mvp.m3,
+        mvp.m4, mvp.m5, mvp.m6, mvp.m7,
+        mvp.m8, mvp.m9, mvp.m10, mvp.m11,
+        mvp.m12, mvp.m13, mvp.m14, mvp.m15
+    };
 
-    if ((vertexCounter + vCount) >=    (vertexBuffer[currentBuffer]->elementCount*4))
+    if (instances)
     {
-        overflow = true;
-        int currentMode = draws[drawCounter - 1]->mode;
-        int currentTexture = draws[drawCounter - 1]->textureId;
+        glUseProgram(instanceShaderId);
+        glUniformMatrix4fv(instanceMpvId, 1, false, mat);
+        glUniform1i(instanceTextId, 0);
+    }
 
-        Render();
-        draws[drawCounter - 1]->mode = currentMode;
-        draws[drawCounter - 1]->textureId = currentTexture;
+    if (arrayShaderId != 0)
+    {
+        glUseProgram(arrayShaderId);
+        glUniformMatrix4fv(arrayMpvId, 1, false, mat);
+        glUniform1i(arrayTextId, 0);
+    }
+    if (multiShaderId != 0)
+    {
+        glUseProgram(multiShaderId);
+        glUniformMatrix4fv(multiMpvId, 1, false, mat);
     }
 
+    glUseProgram(defaultShaderId);
+    glUniformMatrix4fv(mpvId, 1, false, mat);
+    glUniform1i(textId, 0);
 
-    return overflow;
-}
+    glBindVertexArray(buffer.vaoId);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIboId);
 
+    // Strip layout: each quad is 4 indices + restart index, 5 instead of 6
+    int quadMode = quadStrips ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+    int indicesPerQuad = quadStrips ? 5 : 6;
+    int indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(unsigned short) : sizeof(unsigned int);
+    if (quadStrips) glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
 
-void RenderBatch::Begin(int mode)
-{
-    if (draws[drawCounter - 1]->mode != mode)
+    glActiveTexture(GL_TEXTURE0);
+
+    bool spritesBound = false;
+    unsigned int boundProgram = defaultShaderId;
+    for (int i = 0, vertexOffset = 0, instanceOffset = 0; i < count; i++)
     {
-        if (draws[drawCounter - 1]->vertexCount > 0)
+        // NOTE: Only the last draw can be empty (a flush right after it was opened), it has no padding either
+        if (list[i].vertexCount == 0) continue;
+
+        bool textureArray = (list[i].textureId & TEXTURE_ARRAY_BIT) != 0;
+        bool textureTable = (list[i].textureCount > 1);
+        if (textureArray) glBindTexture(GL_TEXTURE_2D_ARRAY, list[i].textureId & ~TEXTURE_ARRAY_BIT);
+        else if (textureTable)
         {
-            if (draws[drawCounter - 1]->mode == LINES) draws[drawCounter - 1]->vertexAlignment = ((draws[drawCounter - 1]->vertexCount < 4)? draws[drawCounter - 1]->vertexCount : draws[drawCounter - 1]->vertexCount%4);
-            else if (draws[drawCounter - 1]->mode == TRIANGLES) draws[drawCounter - 1]->vertexAlignment = ((draws[drawCounter - 1]->vertexCount < 4)? 1 : (4 - (draws[drawCounter - 1]->vertexCount%4)));
-            else draws[drawCounter - 1]->vertexAlignment = 0;
+            for (int k = list[i].textureCount - 1; k >= 0; k--)
+            {
+                glActiveTexture(GL_TEXTURE0 + k);
+                glBindTexture(GL_TEXTURE_2D, list[i].textures[k]);
+            }
+        }
+        else glBindTexture(GL_TEXTURE_2D, list[i].textureId);
 
-            if (!CheckRenderBatchLimit(draws[drawCounter - 1]->vertexAlignment))
+        if (list[i].mode == SPRITES)
+        {
+            if (!spritesBound)
             {
-                vertexCounter += draws[drawCounter - 1]->vertexAlignment;
-                drawCounter++;
+                glUseProgram(instanceShaderId);
+                glBindVertexArray(buffer.instanceVaoId);
+                boundProgram = instanceShaderId;
+                spritesBound = true;
             }
+            glBindBuffer(GL_ARRAY_BUFFER, buffer.instanceVboId);
+            SetInstanceAttributes(instanceOffset);
+            glDrawElementsInstanced(quadMode, quadStrips ? 4 : 6, indexType, 0, list[i].vertexCount);
+            BATCH_STAT(frameStats.drawCalls++);
+            BATCH_STAT(frameStats.instances += list[i].vertexCount);
+
+            instanceOffset += list[i].vertexCount;
+            continue;
+        }
+        if (spritesBound)
+        {
+            glBindVertexArray(buffer.vaoId);
+            spritesBound = false;
         }
 
-        if (drawCounter >= BATCH_DRAWCALLS) Render();
+        unsigned int program = textureArray ? arrayShaderId : (textureTable ? multiShaderId : defaultShaderId);
+        if (program != boundProgram)
+        {
+            glUseProgram(program);
+            boundProgram = program;
+        }
+
+        int mode =GL_LINES;
+        if (list[i].mode == LINES) mode = GL_LINES;
+        else if (list[i].mode == TRIANGLES) mode = GL_TRIANGLES;
+        else if (list[i].mode == QUADS) mode = GL_TRIANGLES;
+
+        if ((list[i].mode == LINES) || (list[i].mode == TRIANGLES)) glDrawArrays(mode, vertexOffset, list[i].vertexCount);
+        else
+        {
+            glDrawElements(quadMode, list[i].vertexCount/4*indicesPerQuad, indexType,(GLvoid *)(size_t)(vertexOffset/4*indicesPerQuad*indexSize));
+        }
+        BATCH_STAT(frameStats.drawCalls++);
+        BATCH_STAT(frameStats.vertices += list[i].vertexCount);
 
-        draws[drawCounter - 1]->mode = mode;
-        draws[drawCounter - 1]->vertexCount = 0;
-        draws[drawCounter - 1]->textureId = defaultTextureId;
+        vertexOffset += (list[i].vertexCount + list[i].vertexAlignment);
     }
+    if (quadStrips) glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);    // Unbind textures
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
 
+// Static batches
+//------------------------------------------------------------------------------------------------
+void RenderBatch::BeginStatic(StaticBatch &target)
+{
+    if (capture != NULL)
+    {
+        Log(1, "BATCH: BeginStatic() while already capturing, ignored");
+        return;
+    }
 
+    if (vertexCounter > 0 || instanceCounter > 0 || !deferredCommands.empty()) Flush(FLUSH_STATIC);
+    captureUploadMode = uploadMode;
+    SetUploadMode(UPLOAD_SUBDATA);
+
+    capture = &target;
+    captureSegments = 0;
+    UpdateCullBounds();
+    target.layout = vertexLayout;
+    target.stride = vertexStride;
+    target.vertexCount = 0;
+    target.instanceCount = 0;
+}
 
-void RenderBatch::Vertex3f(float x, float y, float z)
+void RenderBatch::EndStatic()
 {
-    float tx = x;
-    float ty = y;
-    float tz = z;
+    if (capture == NULL) return;
 
+    Render();       // Last segment
 
-    // if (transformRequired)
-    // {
-    //     tx = transform.m0*x + transform.m4*y + transform.m8*z + transform.m12;
-    //     ty = transform.m1*x + transform.m5*y + transform.m9*z + transform.m13;
-    //     tz = transform.m2*x + transform.m6*y + transform.m10*z + transform.m14;
-    // }
-  //  Log(0," vertex %d  buffer %d",vertexCounter,currentBuffer);
-    
-    if (vertexCounter > (vertexBuffer[currentBuffer]->elementCount*4 - 4))
+    // Segments of a previous, bigger capture
+    StaticBatch &target = *capture;
+    for (size_t i = captureSegments; i < target.segments.size(); i++)
     {
-        if ((draws[drawCounter - 1]->mode == LINES) &&            (draws[drawCounter - 1]->vertexCount%2 == 0))
-        {
-            CheckRenderBatchLimit(2 + 1);
-        }
-        else if ((draws[drawCounter - 1]->mode == TRIANGLES) &&            (draws[drawCounter - 1]->vertexCount%3 == 0))
-        {
-            CheckRenderBatchLimit(3 + 1);
-        }
-        else if ((draws[drawCounter - 1]->mode == QUADS) &&            (draws[drawCounter - 1]->vertexCount%4 == 0))
-        {
-            CheckRenderBatchLimit(4 + 1);
-        }
+        VertexBuffer &buffer = target.segments[i].buffer;
+        if (buffer.vaoId != 0) glDeleteVertexArrays(1, &buffer.vaoId);
+        if (buffer.vboId != 0) glDeleteBuffers(1, &buffer.vboId);
+        if (buffer.instanceVaoId != 0) glDeleteVertexArrays(1, &buffer.instanceVaoId);
+        if (buffer.instanceVboId != 0) glDeleteBuffers(1, &buffer.instanceVboId);
     }
+    target.segments.resize(captureSegments);
 
-    vertexBuffer[currentBuffer]->vertices[vertexCounter].position.set(tx,ty,tz);
-    vertexBuffer[currentBuffer]->vertices[vertexCounter].texcoord.set(texcoordx,texcoordy);
-    vertexBuffer[currentBuffer]->vertices[vertexCounter].color.set(colorr,colorg,colorb,colora);
-
-    vertexCounter++;
-    draws[drawCounter - 1]->vertexCount++;
+    capture = NULL;
+    UpdateCullBounds();
+    SetUploadMode(captureUploadMode);
 }
 
-
-void RenderBatch::Vertex2f(float x, float y)
+// Current buffer as the next segment of the capture (reusing the GL objects of the previous capture)
+void RenderBatch::CaptureStatic()
 {
-    Vertex3f(x, y, currentDepth);
-}
+    if (vertexCounter == 0 && instanceCounter == 0) return;
 
+    StaticBatch &target = *capture;
+    if (captureSegments >= (int)target.segments.size()) target.segments.push_back(StaticSegment());
+    StaticSegment &segment = target.segments[captureSegments++];
 
-void RenderBatch::Vertex2i(int x, int y)
-{
-    Vertex3f((float)x, (float)y, currentDepth);
-}
+    segment.draws.clear();
+    for (int i = 0; i < drawCounter; i++)
+    {
+        if (draws[i].vertexCount == 0) continue;
+        segment.draws.push_back(draws[i]);
+        if (draws[i].mode == SPRITES) continue;
+        target.vertexCount += draws[i].vertexCount;
+    }
+    target.instanceCount += instanceCounter;
 
+    UploadStatic(segment, vertexData, vertexCounter, instanceData, instanceCounter);
+}
 
-void RenderBatch::TexCoord2f(float x, float y)
+// Replace a static buffer and its CPU copy: all of it when the size changed, else only the span of bytes that differ
+template <typename T>
+static unsigned long long UploadStaticBuffer(unsigned int vboId, std::vector<T> &copy, const T *data, int count)
 {
-    texcoordx = x;
-    texcoordy = y;
-}
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t size = (size_t)count*sizeof(T);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vboId);
+    if (copy.size() != (size_t)count)
+    {
+        copy.assign(data, data + count);
+        glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+        return size;
+    }
+
+    const unsigned char *old = (const unsigned char *)copy.data();
+    size_t first = 0;
+    size_t last = size;
+    while (first < size && old[first] == bytes[first]) first++;
+    if (first == size) return 0;
+    while (old[last - 1] == bytes[last - 1]) last--;
+
+    memcpy((unsigned char *)copy.data() + first, bytes + first, last - first);
+    glBufferSubData(GL_ARRAY_BUFFER, first, last - first, bytes + first);
+    return last - first;
+}
+
+// NOTE: Same attribute setup as the dynamic buffers, sharing the quad indices and the unit quad of this batch
+void RenderBatch::UploadStatic(StaticSegment &segment, const unsigned char *vertices, int vertexCount, const QuadInstance *instances, int instanceCount)
+{
+    VertexBuffer &buffer = segment.buffer;
+    unsigned long long bytes = 0;
+
+    if (buffer.vaoId == 0)
+    {
+        glGenVertexArrays(1, &buffer.vaoId);
+        glBindVertexArray(buffer.vaoId);
+        glGenBuffers(1, &buffer.vboId);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.vboId);
+        SetVertexAttributes(vertexLayout);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIboId);
+        glBindVertexArray(0);
+        buffer.vertices.clear();
+    }
+    bytes += UploadStaticBuffer(buffer.vboId, buffer.vertices, vertices, vertexCount*vertexStride);
+
+    if (instanceCount > 0 && buffer.instanceVaoId == 0)
+    {
+        glGenVertexArrays(1, &buffer.instanceVaoId);
+        glBindVertexArray(buffer.instanceVaoId);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVboId);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), 0);
+        glGenBuffers(1, &buffer.instanceVboId);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.instanceVboId);
+        SetInstanceAttributes(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIboId);
+        glBindVertexArray(0);
+        buffer.instances.clear();
+    }
+    if (buffer.instanceVboId != 0) bytes += UploadStaticBuffer(buffer.instanceVboId, buffer.instances, instances, instanceCount);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    segment.dirtyFirst = segment.dirtyLast = 0;
+    segment.dirtyInstanceFirst = segment.dirtyInstanceLast = 0;
+    BATCH_STAT(frameStats.uploadBytes += bytes);
+}
+
+// Pending dynamic draws go first (order kept), then the segments: edited ranges and draw calls only
+void RenderBatch::DrawStatic(StaticBatch &source, const Matrix *transform)
+{
+    if (capture != NULL)
+    {
+        Log(1, "BATCH: DrawStatic() while capturing, ignored");
+        return;
+    }
+    if (source.segments.empty()) return;
+    if (source.layout != vertexLayout)
+    {
+        Log(1, "BATCH: Static batch captured with another vertex layout, not drawn");
+        return;
+    }
+
+    if (vertexCounter > 0 || instanceCounter > 0 || !deferredCommands.empty()) Flush(FLUSH_STATIC);
+
+    Matrix mvp = transformRequired ? matrix*this->transform.ToMatrix() : matrix;
+    if (transform != NULL) mvp = mvp*(*transform);
+    for (size_t s = 0; s < source.segments.size(); s++)
+    {
+        StaticSegment &segment = source.segments[s];
+        VertexBuffer &buffer = segment.buffer;
+        bool instances = !buffer.instances.empty();
+
+        if (rasterizer != NULL)
+        {
+            rasterizer->Submit(segment.draws.data(), (int)segment.draws.size(), vertexLayout, buffer.vertices.data(), buffer.instances.data(), mvp);
+            for (size_t i = 0; i < segment.draws.size(); i++)
+            {
+                BATCH_STAT(frameStats.drawCalls++);
+                BATCH_STAT(if (segment.draws[i].mode == SPRITES) frameStats.instances += segment.draws[i].vertexCount; else frameStats.vertices += segment.draws[i].vertexCount);
+            }
+            continue;
+        }
+
+        if (segment.dirtyLast > segment.dirtyFirst)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer.vboId);
+            glBufferSubData(GL_ARRAY_BUFFER, segment.dirtyFirst*vertexStride, (segment.dirtyLast - segment.dirtyFirst)*vertexStride,
+                            &buffer.vertices[(size_t)segment.dirtyFirst*vertexStride]);
+            BATCH_STAT(frameStats.uploadBytes += (unsigned long long)(segment.dirtyLast - segment.dirtyFirst)*vertexStride);
+            segment.dirtyFirst = segment.dirtyLast = 0;
+        }
+        if (segment.dirtyInstanceLast > segment.dirtyInstanceFirst)
+        {
+            int count = segment.dirtyInstanceLast - segment.dirtyInstanceFirst;
+            glBindBuffer(GL_ARRAY_BUFFER, buffer.instanceVboId);
+            glBufferSubData(GL_ARRAY_BUFFER, segment.dirtyInstanceFirst*sizeof(QuadInstance), count*sizeof(QuadInstance),
+                            &buffer.instances[segment.dirtyInstanceFirst]);
+            BATCH_STAT(frameStats.uploadBytes += (unsigned long long)count*sizeof(QuadInstance));
+            segment.dirtyInstanceFirst = segment.dirtyInstanceLast = 0;
+        }
+
+        DrawList(segment.draws.data(), (int)segment.draws.size(), buffer, instances, mvp);
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void RenderBatch::ResetDraws()
+{
+    vertexCounter = 0;
+    instanceCounter = 0;
+    currentDepth = -1.0f;
+    // Only the used prefix, the rest is still clean
+    for (int i = 0; i < drawCounter; i++)
+    {
+        draws[i].mode =QUADS;
+        draws[i].vertexCount = 0;
+        draws[i].vertexAlignment = 0;
+        draws[i].textureId = defaultTextureId;
+        draws[i].textureCount = 0;
+    }
+    drawCounter = 1;
+    currentBuffer++;
+    if (currentBuffer >= bufferCount) currentBuffer = 0;
+
+    vertexData = vertexBuffer[currentBuffer].vertices.data();
+    instanceData = vertexBuffer[currentBuffer].instances.data();
+    if (uploadMode == UPLOAD_MAPPED) MapBuffers();
+}
+
+// Same draws and buffers as the GL path, the rasterizer copies what it needs before they are reused
+void RenderBatch::SubmitRaster()
+{
+    if (vertexCounter == 0 && instanceCounter == 0) return;
+
+    VertexBuffer &buffer = vertexBuffer[currentBuffer];
+    rasterizer->Submit(draws.data(), drawCounter, vertexLayout, buffer.vertices.data(), buffer.instances.data(), matrix);
+    for (int i = 0; i < drawCounter; i++)
+    {
+        if (draws[i].vertexCount == 0) continue;
+        BATCH_STAT(frameStats.drawCalls++);
+        BATCH_STAT(if (draws[i].mode == SPRITES) frameStats.instances += draws[i].vertexCount; else frameStats.vertices += draws[i].vertexCount);
+    }
+}
+
+void RenderBatch::SetRasterizer(SoftRasterizer *rasterizer)
+{
+    if (rasterizer == this->rasterizer) return;
+    if (vertexBuffer.size() > 0) Render();      // Pending draws go to the previous target
+    this->rasterizer = rasterizer;
+
+    // Mapped memory is write only, the rasterizer reads the CPU copies (see MapBuffers())
+    if (vertexBuffer.size() > 0 && uploadMode == UPLOAD_MAPPED)
+    {
+        if (rasterizer != NULL) UnmapBuffers();
+        else MapBuffers();
+    }
+}
+
+// Map the current buffer region for direct writes
+// NOTE: Unsynchronized maps are only safe because we wait on the fence of the region first
+// NOTE: Returns false when a map failed, writes then go to the CPU copies as with UPLOAD_SUBDATA
+// NOTE: Nothing is mapped while a rasterizer is attached, it reads the region back and mapped memory is write only
+bool RenderBatch::MapBuffers()
+{
+    if (mapped || rasterizer != NULL) return true;
+
+    VertexBuffer *buffer = &vertexBuffer[currentBuffer];
+    if (buffer->fence != 0)
+    {
+        GLenum result = glClientWaitSync(buffer->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        while (result == GL_TIMEOUT_EXPIRED) result = glClientWaitSync(buffer->fence, 0, 1000000000);
+        if (result == GL_WAIT_FAILED) Log(2, "BATCH: [ID %i] Failed to wait on buffer fence", buffer->vboId);
+
+        glDeleteSync(buffer->fence);
+        buffer->fence = 0;
+    }
+
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT;
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->vboId);
+    unsigned char *vertices = (unsigned char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, buffer->vertices.size(), access);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->instanceVboId);
+    QuadInstance *instances = (QuadInstance *)glMapBufferRange(GL_ARRAY_BUFFER, 0, buffer->instances.size()*sizeof(QuadInstance), access);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (vertices == NULL || instances == NULL)
+    {
+        // Hand back only the map that succeeded, the region is uploaded with glBufferSubData() instead
+        Log(2, "BATCH: [ID %i] Failed to map vertex buffer, uploading with glBufferSubData()", buffer->vboId);
+        if (vertices != NULL)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer->vboId);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        if (instances != NULL)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer->instanceVboId);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return false;
+    }
+
+    vertexData = vertices;
+    instanceData = instances;
+    mapped = true;
+    return true;
+}
+
+// Flush the written ranges and hand the region back to GL
+void RenderBatch::UnmapBuffers()
+{
+    if (!mapped) return;
+
+    VertexBuffer *buffer = &vertexBuffer[currentBuffer];
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->vboId);
+    if (vertexCounter > 0 && vertexData != buffer->vertices.data()) glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, vertexCounter*vertexStride);
+    if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) Log(1, "BATCH: [ID %i] Vertex buffer contents lost while mapped", buffer->vboId);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->instanceVboId);
+    if (instanceCounter > 0 && instanceData != buffer->instances.data()) glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, instanceCounter*sizeof(QuadInstance));
+    if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) Log(1, "BATCH: [ID %i] Instance buffer contents lost while mapped", buffer->instanceVboId);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    vertexData = buffer->vertices.data();
+    instanceData = buffer->instances.data();
+    mapped = false;
+}
+
+// (Re)build the shared quad index buffer for quadIndexCount quads
+// NOTE: 16 bit indices while the last vertex index stays below the 0xFFFF restart index
+void RenderBatch::LoadQuadIndices()
+{
+    bool shortIndices = (quadIndexCount*4 - 1) < 0xFFFF;
+    int indicesPerQuad = quadStrips ? 5 : 6;
+
+    std::vector<unsigned int> indices(quadIndexCount*indicesPerQuad);
+    unsigned int *index = indices.data();
+    for (unsigned int k = 0; k < (unsigned int)quadIndexCount*4; k += 4)
+    {
+        if (quadStrips)
+        {
+            // top-left, bottom-left, top-right, bottom-right: same CCW winding as the triangle pairs
+            *index++ = k;
+            *index++ = k + 1;
+            *index++ = k + 3;
+            *index++ = k + 2;
+            *index++ = shortIndices ? 0xFFFF : 0xFFFFFFFF;
+        }
+        else
+        {
+            *index++ = k;
+            *index++ = k + 1;
+            *index++ = k + 2;
+            *index++ = k;
+            *index++ = k + 2;
+            *index++ = k + 3;
+        }
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIboId);
+    if (shortIndices)
+    {
+        std::vector<unsigned short> shorts(indices.begin(), indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shorts.size()*sizeof(unsigned short), shorts.data(), GL_STATIC_DRAW);
+        indexType = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        indexType = GL_UNSIGNED_INT;
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    Log(0, "BATCH: [ID %i] Quad index buffer loaded (%i quads, %s, %i bit)", quadIboId, quadIndexCount, quadStrips ? "strips" : "triangles", shortIndices ? 16 : 32);
+}
+
+void RenderBatch::SetQuadStrips(bool enable)
+{
+    if (enable == quadStrips) return;
+
+    quadStrips = enable;
+    if (vertexBuffer.size() > 0)
+    {
+        Render();           // Pending quads were counted with the previous layout
+        LoadQuadIndices();  // Same buffer object, VAO bindings stay valid
+    }
+}
+
+// NOTE: Returns false when the buffers could not be mapped, the mode then stays UPLOAD_SUBDATA
+bool RenderBatch::SetUploadMode(UploadMode mode)
+{
+    if (mode == uploadMode) return true;
+
+    if (vertexBuffer.size() > 0)
+    {
+        Render();           // Submit whatever was written with the previous mode
+        UnmapBuffers();
+    }
+    uploadMode = mode;
+    if (vertexBuffer.size() > 0 && uploadMode == UPLOAD_MAPPED && !MapBuffers())
+    {
+        uploadMode = UPLOAD_SUBDATA;
+        return false;
+    }
+    return true;
+}
+
+// Mode and texture table of the current draw, carried over a flush (slots stay valid)
+void RenderBatch::SaveDrawState(DrawCall &state) const
+{
+    state = draws[drawCounter - 1];
+}
+
+void RenderBatch::RestoreDrawState(const DrawCall &state)
+{
+    DrawCall *draw = &draws[drawCounter - 1];
+    draw->mode = state.mode;
+    draw->textureId = state.textureId;
+    draw->textureCount = state.textureCount;
+    for (int i = 0; i < state.textureCount; i++) draw->textures[i] = state.textures[i];
+}
+
+// Out of draws: double the table instead of flushing, new entries are reset like the unused ones
+// NOTE: Invalidates DrawCall pointers into the table
+void RenderBatch::GrowDraws()
+{
+    size_t used = draws.size();
+    draws.resize(used*2);
+    for (size_t i = used; i < draws.size(); i++)
+    {
+        draws[i].mode = QUADS;
+        draws[i].vertexCount = 0;
+        draws[i].vertexAlignment = 0;
+        draws[i].textureId = defaultTextureId;
+        draws[i].textureCount = 0;
+    }
+}
+
+bool RenderBatch::CheckRenderBatchLimit(int vCount)
+{
+    bool overflow = false;
+
+
+    if ((vertexCounter + vCount) >=    (vertexBuffer[currentBuffer].elementCount*4))
+    {
+        overflow = true;
+        DrawCall state;
+        SaveDrawState(state);
+
+        Flush(FLUSH_BUFFER_FULL);
+        RestoreDrawState(state);
+    }
+
+
+    return overflow;
+}
+
+bool RenderBatch::CheckInstanceLimit(int iCount)
+{
+    bool overflow = false;
+
+    if ((instanceCounter + iCount) > vertexBuffer[currentBuffer].elementCount)
+    {
+        overflow = true;
+        DrawCall state;
+        SaveDrawState(state);
+
+        Flush(FLUSH_BUFFER_FULL);
+        RestoreDrawState(state);
+    }
+
+    return overflow;
+}
+
+void RenderBatch::Flush(FlushReason reason)
+{
+    flushReason = reason;
+    Render();
+}
+
+void RenderBatch::ResetFrameStats()
+{
+#if BATCH_STATS
+    totalStats.drawCalls += frameStats.drawCalls;
+    totalStats.vertices += frameStats.vertices;
+    totalStats.instances += frameStats.instances;
+    totalStats.uploadBytes += frameStats.uploadBytes;
+    totalStats.paddingVertices += frameStats.paddingVertices;
+    totalStats.culled += frameStats.culled;
+    for (int i = 0; i < FLUSH_REASON_COUNT; i++) totalStats.flushes[i] += frameStats.flushes[i];
+    memset(&frameStats, 0, sizeof(RenderStats));
+    frameBreaks.clear();
+#endif
+}
+
+void RenderBatch::CountFlush(FlushReason reason)
+{
+#if BATCH_STATS
+    frameStats.flushes[reason]++;
+    if (!breakTracking) return;
+
+    // NOTE: A handful of labels per frame, a linear search beats hashing
+    for (size_t i = 0; i < frameBreaks.size(); i++)
+    {
+        if (frameBreaks[i].label == breakLabel && frameBreaks[i].reason == reason)
+        {
+            frameBreaks[i].count++;
+            return;
+        }
+    }
+    BatchBreak entry = { breakLabel, reason, 1 };
+    frameBreaks.push_back(entry);
+#else
+    (void)reason;
+#endif
+}
+
+void RenderBatch::SetBreakTracking(bool enable)
+{
+#if BATCH_STATS
+    breakTracking = enable;
+    frameBreaks.clear();
+#else
+    if (enable) Log(1, "BATCH: Break tracking needs BATCH_STATS");
+#endif
+}
+
+void RenderBatch::LogBreakReport(int maxEntries) const
+{
+    static const char *reasonNames[FLUSH_REASON_COUNT] = { "buffer full", "texture", "mode", "render", "static" };
+
+    std::vector<BatchBreak> report(frameBreaks);
+    std::stable_sort(report.begin(), report.end(), [](const BatchBreak &a, const BatchBreak &b) { return a.count > b.count; });
+
+    if (report.empty()) Log(0, "BATCH: No batch breaks recorded%s", breakTracking ? "" : " (tracking is off)");
+    for (int i = 0; i < (int)report.size() && i < maxEntries; i++)
+    {
+        Log(0, "BATCH: %5u %-11s %s", report[i].count, reasonNames[report[i].reason], report[i].label ? report[i].label : "(no label)");
+    }
+}
+
+
+void RenderBatch::Begin(int mode)
+{
+    // Immediate geometry goes after everything recorded so far
+    if (IsRecording()) ReplayDeferred();
+
+    if (draws[drawCounter - 1].mode != mode)
+    {
+        if (draws[drawCounter - 1].vertexCount > 0)
+        {
+            if (draws[drawCounter - 1].mode == LINES) draws[drawCounter - 1].vertexAlignment = ((draws[drawCounter - 1].vertexCount < 4)? draws[drawCounter - 1].vertexCount : draws[drawCounter - 1].vertexCount%4);
+            else if (draws[drawCounter - 1].mode == TRIANGLES) draws[drawCounter - 1].vertexAlignment = ((draws[drawCounter - 1].vertexCount < 4)? 1 : (4 - (draws[drawCounter - 1].vertexCount%4)));
+            else draws[drawCounter - 1].vertexAlignment = 0;
+
+            if (!CheckRenderBatchLimit(draws[drawCounter - 1].vertexAlignment))
+            {
+                vertexCounter += draws[drawCounter - 1].vertexAlignment;
+                BATCH_STAT(frameStats.paddingVertices += draws[drawCounter - 1].vertexAlignment);
+                BATCH_STAT(CountFlush(FLUSH_MODE));
+                drawCounter++;
+            }
+        }
+
+        if (drawCounter >= (int)draws.size()) GrowDraws();
+
+        draws[drawCounter - 1].mode = mode;
+        draws[drawCounter - 1].vertexCount = 0;
+        draws[drawCounter - 1].textureId = defaultTextureId;
+        draws[drawCounter - 1].textureCount = 0;
+    }
+}
+
+
+
+void RenderBatch::Vertex3f(float x, float y, float z)
+{
+    float tx = x;
+    float ty = y;
+    float tz = z;
+
+    if (transformRequired)
+    {
+        tx = transform.a*x + transform.c*y + transform.tx;
+        ty = transform.b*x + transform.d*y + transform.ty;
+    }
+    
+    if (vertexCounter > (vertexBuffer[currentBuffer].elementCount*4 - 4))
+    {
+        if ((draws[drawCounter - 1].mode == LINES) &&            (draws[drawCounter - 1].vertexCount%2 == 0))
+        {
+            CheckRenderBatchLimit(2 + 1);
+        }
+        else if ((draws[drawCounter - 1].mode == TRIANGLES) &&            (draws[drawCounter - 1].vertexCount%3 == 0))
+        {
+            CheckRenderBatchLimit(3 + 1);
+        }
+        else if ((draws[drawCounter - 1].mode == QUADS) &&            (draws[drawCounter - 1].vertexCount%4 == 0))
+        {
+            CheckRenderBatchLimit(4 + 1);
+        }
+    }
+
+    WriteVertex(vertexLayout, vertexData + vertexCounter*vertexStride, tx, ty, tz, texcoordx, texcoordy, colorr, colorg, colorb, colora);
+    if (textureSlots > 1) ((Vertex *)(vertexData + vertexCounter*vertexStride))->slot = (unsigned short)textureSlot;
+
+    vertexCounter++;
+    draws[drawCounter - 1].vertexCount++;
+}
+
+
+void RenderBatch::Vertex2f(float x, float y)
+{
+    Vertex3f(x, y, currentDepth);
+}
+
+
+void RenderBatch::Vertex2i(int x, int y)
+{
+    Vertex3f((float)x, (float)y, currentDepth);
+}
+
+
+void RenderBatch::TexCoord2f(float x, float y)
+{
+    texcoordx = x;
+    texcoordy = y;
+}
 
 
 
@@ -645,75 +1721,914 @@ void RenderBatch::Color4ub(unsigned char x, unsigned char y, unsigned char z, un
     colora = w;
 }
 
-
-void RenderBatch::Color4f(float r, float g, float b, float a)
+
+void RenderBatch::Color4f(float r, float g, float b, float a)
+{
+    Color4ub((unsigned char)(r*255), (unsigned char)(g*255), (unsigned char)(b*255), (unsigned char)(a*255));
+}
+
+void RenderBatch::setMatrix(const Matrix &matrix)
+{
+    this->matrix = matrix;
+    if (cullAuto) UpdateCullBounds();
+    UpdateLodScale();
+}
+
+void RenderBatch::SetTransform(const Transform2D &mat)
+{
+    transform = mat;
+    transformRequired = !transform.IsIdentity();
+    transformConformal = transform.IsConformal();
+    UpdateCullBounds();
+    UpdateLodScale();
+}
+
+void RenderBatch::PushMatrix()
+{
+    if ((int)transformStack.size() >= MAX_MATRIX_STACK_SIZE)
+    {
+        Log(2, "BATCH: Matrix stack overflow (MAX_MATRIX_STACK_SIZE)");
+        return;
+    }
+    transformStack.push_back(transform);
+}
+
+void RenderBatch::PopMatrix()
+{
+    if (transformStack.empty())
+    {
+        Log(1, "BATCH: PopMatrix() with an empty matrix stack");
+        return;
+    }
+    SetTransform(transformStack.back());
+    transformStack.pop_back();
+}
+
+void RenderBatch::LoadIdentity()
+{
+    SetTransform(Transform2D());
+}
+
+void RenderBatch::Translate(float x, float y)
+{
+    SetTransform(transform*Transform2D(1.0f, 0.0f, 0.0f, 1.0f, x, y));
+}
+
+void RenderBatch::Rotate(float degrees)
+{
+    float s = sinf(degrees*DEG2RAD);
+    float c = cosf(degrees*DEG2RAD);
+    SetTransform(transform*Transform2D(c, s, -s, c, 0.0f, 0.0f));
+}
+
+void RenderBatch::Scale(float x, float y)
+{
+    SetTransform(transform*Transform2D(x, 0.0f, 0.0f, y, 0.0f, 0.0f));
+}
+
+void RenderBatch::MultTransform(const Transform2D &mat)
+{
+    SetTransform(transform*mat);
+}
+
+// SPRITES instances hold no layer and only rotate and scale uniformly, the rest goes through QUADS
+bool RenderBatch::CanInstance(unsigned int textureId) const
+{
+    return instancing && !(textureId & TEXTURE_ARRAY_BIT) && (!transformRequired || transformConformal);
+}
+
+// Viewport culling
+//------------------------------------------------------------------------------------------------
+void RenderBatch::SetCulling(bool enable)
+{
+    culling = enable;
+    UpdateCullBounds();
+}
+
+void RenderBatch::SetCullRect(const Rectangle &rect)
+{
+    cullRect = rect;
+    cullAuto = false;
+    UpdateCullBounds();
+}
+
+void RenderBatch::ResetCullRect()
+{
+    cullAuto = true;
+    UpdateCullBounds();
+}
+
+// World rect of the clip square [-1, 1] under an affine 2D projection
+static bool GetProjectionRect(const Matrix &mat, Rectangle &rect)
+{
+    if ((mat.m3 != 0.0f) || (mat.m7 != 0.0f) || (mat.m15 != 1.0f)) return false;      // Perspective
+
+    Transform2D projection(mat.m0, mat.m1, mat.m4, mat.m5, mat.m12, mat.m13);
+    Transform2D inverse;
+    if (!projection.Invert(inverse)) return false;
+
+    float bounds[4];
+    inverse.ApplyBounds(-1.0f, -1.0f, 1.0f, 1.0f, bounds);
+    rect = Rectangle(bounds[0], bounds[1], bounds[2] - bounds[0], bounds[3] - bounds[1]);
+    return true;
+}
+
+// Cull rect moved into the space of the transform top, so emitters test their own coordinates
+void RenderBatch::UpdateCullBounds()
+{
+    cullActive = false;
+    if (!culling || (capture != NULL)) return;
+
+    Rectangle rect = cullRect;
+    if (cullAuto && !GetProjectionRect(matrix, rect)) return;
+
+    if (transformRequired)
+    {
+        Transform2D inverse;
+        if (!transform.Invert(inverse)) return;
+        inverse.ApplyBounds(rect.x, rect.y, rect.x + rect.width, rect.y + rect.height, cullBounds);
+    }
+    else
+    {
+        cullBounds[0] = rect.x;
+        cullBounds[1] = rect.y;
+        cullBounds[2] = rect.x + rect.width;
+        cullBounds[3] = rect.y + rect.height;
+    }
+    cullActive = true;
+}
+
+bool RenderBatch::IsCulled(const float *bounds)
+{
+    if (!cullActive) return false;
+    if ((bounds[2] >= cullBounds[0]) && (bounds[0] <= cullBounds[2]) && (bounds[3] >= cullBounds[1]) && (bounds[1] <= cullBounds[3])) return false;
+
+    BATCH_STAT(frameStats.culled++);
+    return true;
+}
+
+// Circle tessellation
+//------------------------------------------------------------------------------------------------
+void RenderBatch::SetViewport(int width, int height)
+{
+    viewportWidth = std::max(width, 0);
+    viewportHeight = std::max(height, 0);
+    UpdateLodScale();
+}
+
+// Geometric mean of the axis scales (sqrt of the area ratio), so skewed or squashed views still get a sensible count
+void RenderBatch::UpdateLodScale()
+{
+    float scale = transformRequired ? sqrtf(fabsf(transform.a*transform.d - transform.b*transform.c)) : 1.0f;
+    if ((viewportWidth > 0) && (viewportHeight > 0))
+    {
+        float det = fabsf(matrix.m0*matrix.m5 - matrix.m1*matrix.m4);
+        scale *= sqrtf(det*(float)viewportWidth*(float)viewportHeight*0.25f);
+    }
+    lodScale = (scale > 0.0f) ? scale : 1.0f;
+}
+
+static int ComputeCircleSegments(float screenRadius)
+{
+    if (screenRadius <= SMOOTH_CIRCLE_ERROR_RATE) return 4;
+
+    // Maximum angle between segments based on the error rate (usually 0.5f)
+    float th = acosf(2*powf(1 - SMOOTH_CIRCLE_ERROR_RATE/screenRadius, 2) - 1);
+    return std::max(4, (int)ceilf(2*PI/th));
+}
+
+// Segments of an arc: the given ones when enough, else from the screen radius (cached by whole pixel)
+// NOTE: At most 90 degrees per segment, so two segments of a fan always make a convex quad
+int RenderBatch::GetArcSegments(float radius, float startAngle, float endAngle, int segments)
+{
+    int minSegments = (int)ceilf((endAngle - startAngle)/90);
+    if (segments >= minSegments) return segments;
+
+    // NOTE: Negative radii (ring radii both below 0) and NaN would index the cache out of bounds
+    float screenRadius = radius*lodScale;
+    if (!(screenRadius > 0.0f)) screenRadius = 0.0f;
+    int fullSegments;
+    if (screenRadius < CIRCLE_LOD_MAX_RADIUS)
+    {
+        int key = (int)ceilf(screenRadius);
+        if (circleSegments.empty()) circleSegments.resize(CIRCLE_LOD_MAX_RADIUS + 1, 0);
+        if (circleSegments[key] == 0) circleSegments[key] = (unsigned short)ComputeCircleSegments((float)key);
+        fullSegments = circleSegments[key];
+    }
+    else fullSegments = ComputeCircleSegments(screenRadius);
+
+    segments = (int)((endAngle - startAngle)*fullSegments/360);
+    return std::max(segments, minSegments);
+}
+
+// segments + 1 unit circle points from startAngle to endAngle (degrees)
+// NOTE: Full circles come from the cached tables (starting at 0 degrees whatever startAngle is), arcs are stepped
+//       with a rotation from the first point: 4 trig calls per arc instead of 4 per segment
+const Vector2 *RenderBatch::GetArc(float startAngle, float endAngle, int segments)
+{
+    if ((endAngle - startAngle == 360.0f) && (segments <= CIRCLE_TABLE_MAX_SEGMENTS))
+    {
+        if ((int)circleTables.size() <= segments) circleTables.resize(segments + 1);
+        std::vector<Vector2> &table = circleTables[segments];
+        if (table.empty())
+        {
+            table.resize(segments + 1);
+            for (int i = 0; i < segments; i++)
+            {
+                double angle = 2.0*3.14159265358979323846*i/segments;
+                table[i].set((float)cos(angle), (float)sin(angle));
+            }
+            table[segments] = table[0];
+        }
+        return table.data();
+    }
+
+    if ((int)arcScratch.size() < segments + 1) arcScratch.resize(segments + 1);
+    float step = DEG2RAD*(endAngle - startAngle)/(float)segments;
+    float stepCos = cosf(step);
+    float stepSin = sinf(step);
+    float x = cosf(DEG2RAD*startAngle);
+    float y = sinf(DEG2RAD*startAngle);
+    for (int i = 0; i < segments; i++)
+    {
+        arcScratch[i].set(x, y);
+        float nx = x*stepCos - y*stepSin;
+        y = x*stepSin + y*stepCos;
+        x = nx;
+    }
+    arcScratch[segments].set(cosf(DEG2RAD*endAngle), sinf(DEG2RAD*endAngle));    // Exact end, no drift at the seam
+    return arcScratch.data();
+}
+
+// SDF shapes
+//------------------------------------------------------------------------------------------------
+// The open QUADS draw keeps its texture (shape fragments never sample it), else the shapes texture
+// NOTE: Never 0, Reserve() would point the texcoords at the shapes texel
+unsigned int RenderBatch::GetShapeTexture() const
+{
+    const DrawCall &draw = draws[drawCounter - 1];
+    if (!IsRecording() && (draw.mode == QUADS) && (draw.vertexCount > 0) && !(draw.textureId & TEXTURE_ARRAY_BIT)) return draw.textureId;
+    return (shapesTextureId != 0) ? shapesTextureId : defaultTextureId;
+}
+
+// Quad center +- extent, each corner gets its shape position (offset projected on the shape axes)
+void RenderBatch::DrawShapeQuad(const Vector2 &center, float extentX, float extentY, const Vector2 &axisX, const Vector2 &axisY, unsigned short shape, unsigned short param, const Color &color)
+{
+    Vertex *v = Reserve(QUADS, GetShapeTexture(), 4);
+    if (v == NULL) return;
+
+    // top-left, bottom-left, bottom-right, top-right as DrawRectanglePro()
+    static const float corners[8] = { -1.0f, -1.0f,  -1.0f, 1.0f,  1.0f, 1.0f,  1.0f, -1.0f };
+    for (int i = 0; i < 4; i++)
+    {
+        float dx = corners[i*2]*extentX;
+        float dy = corners[i*2 + 1]*extentY;
+        PutVertex(v, center.x + dx, center.y + dy, currentDepth, dx*axisX.x + dy*axisX.y, dx*axisY.x + dy*axisY.y, color, param);
+        v[-1].slot = shape;
+    }
+    sdfSpan = true;
+    Commit();
+}
+
+// Disc, ellipse, ring or sector of them (radii in world units, innerRatio of the outer radius)
+void RenderBatch::DrawArcShape(const Vector2 &center, float radiusX, float radiusY, float innerRatio, float startAngle, float endAngle, bool outline, const Color &color)
+{
+    radiusX = std::max(fabsf(radiusX), 0.1f);
+    radiusY = std::max(fabsf(radiusY), 0.1f);
+    float margin = SHAPE_AA_MARGIN/lodScale;
+    unsigned short shape = SHAPE_SDF_BIT | (outline ? SHAPE_OUTLINE_BIT : 0) | (unsigned short)(std::max(0.0f, std::min(innerRatio, 1.0f))*4095.0f + 0.5f);
+    unsigned short aperture = 65535;
+    Vector2 axisX(1.0f/radiusX, 0.0f);
+    Vector2 axisY(0.0f, 1.0f/radiusY);
+
+    // Sectors: local +x on the middle angle (circles only, radiusX == radiusY)
+    if (endAngle - startAngle < 360.0f)
+    {
+        float middle = DEG2RAD*(startAngle + endAngle)*0.5f;
+        float c = cosf(middle)/radiusX;
+        float s = sinf(middle)/radiusX;
+        axisX.set(c, s);
+        axisY.set(-s, c);
+        aperture = (unsigned short)((endAngle - startAngle)/360.0f*65535.0f + 0.5f);
+    }
+
+    DrawShapeQuad(center, radiusX + margin, radiusY + margin, axisX, axisY, shape, aperture, color);
+}
+
+// Local x along the long side, so the SDF only needs the short half size
+void RenderBatch::DrawRoundedShape(const Rectangle &rec, float radius, bool outline, const Color &color)
+{
+    float margin = SHAPE_AA_MARGIN/lodScale;
+    float halfWidth = rec.width*0.5f;
+    float halfHeight = rec.height*0.5f;
+    float longHalf = std::max(halfWidth, halfHeight);
+    float shortHalf = std::min(halfWidth, halfHeight);
+
+    unsigned short shape = SHAPE_SDF_BIT | SHAPE_ROUNDED_RECT_BIT | (outline ? SHAPE_OUTLINE_BIT : 0) | (unsigned short)(std::min(radius/longHalf, 1.0f)*4095.0f + 0.5f);
+    unsigned short param = (unsigned short)(shortHalf/longHalf*65535.0f + 0.5f);
+    Vector2 axisX(1.0f/longHalf, 0.0f);
+    Vector2 axisY(0.0f, 1.0f/longHalf);
+    if (halfHeight > halfWidth) std::swap(axisX, axisY);
+
+    DrawShapeQuad(Vector2(rec.x + halfWidth, rec.y + halfHeight), halfWidth + margin, halfHeight + margin, axisX, axisY, shape, param, color);
+}
+
+// Closed outline of a rounded rectangle in outlineScratch (first point repeated at the end), returns the segment count
+// NOTE: Corners clockwise on screen from the bottom-right one, the angle order of GetArc()
+int RenderBatch::GetRoundedOutline(const Rectangle &rec, float radius, int segments)
+{
+    segments = GetArcSegments(radius, 0.0f, 90.0f, segments);
+    const Vector2 *arc = GetArc(0.0f, 90.0f, segments);
+    Vector2 centers[4] = { Vector2(rec.x + rec.width - radius, rec.y + rec.height - radius), Vector2(rec.x + radius, rec.y + rec.height - radius),
+                           Vector2(rec.x + radius, rec.y + radius), Vector2(rec.x + rec.width - radius, rec.y + radius) };
+
+    int count = 4*(segments + 1);
+    outlineScratch.resize(count + 1);
+    for (int corner = 0, k = 0; corner < 4; corner++)
+    {
+        for (int i = 0; i <= segments; i++, k++)
+        {
+            // Quarter turns: (x, y) -> (-y, x)
+            float x = arc[i].x, y = arc[i].y;
+            for (int turn = 0; turn < corner; turn++)
+            {
+                float t = x;
+                x = -y;
+                y = t;
+            }
+            outlineScratch[k].set(centers[corner].x + x*radius, centers[corner].y + y*radius);
+        }
+    }
+    outlineScratch[count] = outlineScratch[0];
+    return count;
+}
+
+ 
+void RenderBatch::SetInstancing(bool enable)
+{
+    if (enable && instanceShaderId == 0)
+    {
+        Log(1, "BATCH: Instanced sprites not available, keeping QUADS path");
+        return;
+    }
+    instancing = enable;
+}
+
+void RenderBatch::Color3f(float x, float y, float z)
+{
+    Color4ub((unsigned char)(x*255), (unsigned char)(y*255), (unsigned char)(z*255), 255);
+}
+
+void RenderBatch::SetTexture(unsigned int id)
+{
+    if (id == 0)
+    {
+        if (vertexCounter >=    vertexBuffer[currentBuffer].elementCount*4)
+        {
+            Flush(FLUSH_BUFFER_FULL);
+        }
+    }
+    else
+    {
+        // Texture table: a draw only closes once all its slots are taken
+        // NOTE: SPRITES and texture arrays have their own samplers and keep one texture per draw
+        DrawCall *draw = &draws[drawCounter - 1];
+        if ((textureSlots > 1) && (draw->mode != SPRITES) && !(id & TEXTURE_ARRAY_BIT) && !(draw->textureId & TEXTURE_ARRAY_BIT))
+        {
+            for (int i = 0; i < draw->textureCount; i++)
+            {
+                if (draw->textures[i] == id)
+                {
+                    textureSlot = i;
+                    return;
+                }
+            }
+            if (draw->textureCount < textureSlots)
+            {
+                if (draw->textureCount == 0) draw->textureId = id;
+                textureSlot = draw->textureCount;
+                draw->textures[draw->textureCount++] = id;
+                return;
+            }
+        }
+
+        if (draws[drawCounter - 1].textureId != id || draws[drawCounter - 1].textureCount > 1)
+        {
+            if (draws[drawCounter - 1].vertexCount > 0)
+            {
+                if (draws[drawCounter - 1].mode == LINES) draws[drawCounter - 1].vertexAlignment = ((draws[drawCounter - 1].vertexCount < 4)? draws[drawCounter - 1].vertexCount : draws[drawCounter - 1].vertexCount%4);
+                else if (draws[drawCounter - 1].mode == TRIANGLES) draws[drawCounter - 1].vertexAlignment = ((draws[drawCounter - 1].vertexCount < 4)? 1 : (4 - (draws[drawCounter - 1].vertexCount%4)));
+                else draws[drawCounter - 1].vertexAlignment = 0;
+
+                if (!CheckRenderBatchLimit(draws[drawCounter - 1].vertexAlignment))
+                {
+                    vertexCounter += draws[drawCounter - 1].vertexAlignment;
+                    BATCH_STAT(frameStats.paddingVertices += draws[drawCounter - 1].vertexAlignment);
+                    BATCH_STAT(CountFlush(FLUSH_TEXTURE));
+                    drawCounter++;
+                }
+            }
+
+            if (drawCounter >= (int)draws.size()) GrowDraws();
+
+            draws[drawCounter - 1].textureId = id;
+            draws[drawCounter - 1].vertexCount = 0;
+            draws[drawCounter - 1].textures[0] = id;
+            draws[drawCounter - 1].textureCount = 1;
+            textureSlot = 0;
+        }
+
+    }
+}
+
+void RenderBatch::SetShapesTexture(const Texture2D &texture, const Rectangle &source)
+{
+    if (texture.id == 0 || (texture.id & TEXTURE_ARRAY_BIT) || texture.width <= 0 || texture.height <= 0)
+    {
+        Log(1, "BATCH: Shapes texture must be a 2D texture, keeping the current one");
+        return;
+    }
+
+    // NOTE: No flush, spans already emitted keep the texture and texel resolved on Reserve()/Commit()
+    shapesTextureId = texture.id;
+    shapesU = texture.uvOffset.x + (source.x + source.width*0.5f)/(float)texture.width*texture.uvScale.x;
+    shapesV = texture.uvOffset.y + (source.y + source.height*0.5f)/(float)texture.height*texture.uvScale.y;
+}
+
+void RenderBatch::ResetShapesTexture()
+{
+    shapesTextureId = 0;
+    shapesU = 0.0f;
+    shapesV = 0.0f;
+}
+
+
+
+void RenderBatch::End(void)
+{
+    currentDepth=0.0f;
+
+   // currentDepth += (1.0f/20000.0f);
+}
+
+
+// Open a span of vertexCount vertices for mode/texture (0: shapes texture, default texture unless set)
+// NOTE: State and overflow are resolved once here, the span must be filled and committed before any other draw
+Vertex *RenderBatch::Reserve(int mode, unsigned int textureId, int vertexCount)
+{
+    if (vertexCount > vertexBuffer[currentBuffer].elementCount*4 - 4)
+    {
+        Log(1, "BATCH: Reserve of %i vertices exceeds the buffer capacity", vertexCount);
+        return NULL;
+    }
+
+    shapesSpan = (textureId == 0) && (shapesTextureId != 0);
+    if (textureId == 0) textureId = shapesSpan ? shapesTextureId : defaultTextureId;
+    reservedCount = vertexCount;
+
+    if (IsRecording())
+    {
+        int first = (int)deferredVertices.size();
+        RecordCommand(mode, textureId, first, vertexCount);
+        deferredVertices.resize(first + vertexCount);
+        return &deferredVertices[first];
+    }
+
+    Begin(mode);
+    SetTexture(textureId);
+    CheckRenderBatchLimit(vertexCount);
+
+    // NOTE: The transform reads positions back, a mapped buffer is write only (and slow to read)
+    reserveStaged = (vertexLayout != VERTEX_LAYOUT_DEFAULT) || (transformRequired && mapped);
+    if (!reserveStaged) return (Vertex *)(vertexData + vertexCounter*vertexStride);
+
+    if ((int)reserveStaging.size() < vertexCount) reserveStaging.resize(vertexCount);
+    return reserveStaging.data();
+}
+
+// Largest span Reserve() takes, emitters of caller sized shapes (segments) split them into spans of this
+int RenderBatch::GetSpanCapacity() const
+{
+    return vertexBuffer[currentBuffer].elementCount*4 - 4;
+}
+
+// Close the span opened by Reserve(), packing it when the batch uses a compact layout
+void RenderBatch::Commit()
+{
+    Vertex *span = IsRecording() ? &deferredVertices[deferredVertices.size() - reservedCount] :
+                   (reserveStaged ? reserveStaging.data() : (Vertex *)(vertexData + vertexCounter*vertexStride));
+
+    // Shape emitters write no texcoords worth keeping, point them all at the shapes texel
+    if (shapesSpan)
+    {
+        for (int i = 0; i < reservedCount; i++) span[i].texcoord.set(shapesU, shapesV);
+        shapesSpan = false;
+    }
+
+    if (transformRequired) TransformVertices(span, reservedCount, transform, GetSpritePath());
+
+    if (IsRecording())
+    {
+        reservedCount = 0;
+        sdfSpan = false;
+        End();
+        return;
+    }
+
+    if (vertexLayout != VERTEX_LAYOUT_DEFAULT)
+    {
+        unsigned char *dst = vertexData + vertexCounter*vertexStride;
+        for (int i = 0; i < reservedCount; i++, dst += vertexStride)
+        {
+            const Vertex &vertex = reserveStaging[i];
+            WriteVertex(vertexLayout, dst, vertex.position.x, vertex.position.y, vertex.position.z, vertex.texcoord.x, vertex.texcoord.y,
+                        vertex.color.r, vertex.color.g, vertex.color.b, vertex.color.a);
+        }
+    }
+    else if (reserveStaged)
+    {
+        memcpy(vertexData + vertexCounter*vertexStride, reserveStaging.data(), reservedCount*sizeof(Vertex));
+    }
+    reserveStaged = false;
+
+    // NOTE: Write only, the span may be mapped. SDF quads carry their shape in the slot field and keep it
+    if (textureSlots > 1 && !sdfSpan)
+    {
+        Vertex *vertex = (Vertex *)(vertexData + vertexCounter*vertexStride);
+        for (int i = 0; i < reservedCount; i++) vertex[i].slot = (unsigned short)textureSlot;
+    }
+    sdfSpan = false;
+
+    vertexCounter += reservedCount;
+    draws[drawCounter - 1].vertexCount += reservedCount;
+    reservedCount = 0;
+    End();
+}
+
+// Writable run of count SPRITES instances, filled by the caller before any other draw
+QuadInstance *RenderBatch::PushInstances(unsigned int textureId, int count)
+{
+    if (IsRecording())
+    {
+        int first = (int)deferredInstances.size();
+        RecordCommand(SPRITES, textureId, first, count);
+        deferredInstances.resize(first + count);
+        return &deferredInstances[first];
+    }
+
+    // NOTE: Mode first, Begin() resets the draw texture on mode change
+    Begin(SPRITES);
+    SetTexture(textureId);
+    CheckInstanceLimit(count);
+
+    QuadInstance *instances = instanceData + instanceCounter;
+    instanceCounter += count;
+    draws[drawCounter - 1].vertexCount += count;
+    return instances;
+}
+
+// Sort key, most significant first: layer (8) | shader (4) | texture slot (16) | mode (4) | submission order (32)
+// NOTE: Texture slots follow first use in the frame, so the sorted output is deterministic
+void RenderBatch::RecordCommand(int mode, unsigned int textureId, int first, int count)
+{
+    std::unordered_map<unsigned int, int>::iterator slot = deferredTextures.find(textureId);
+    if (slot == deferredTextures.end()) slot = deferredTextures.insert(std::make_pair(textureId, (int)deferredTextures.size())).first;
+
+    unsigned long long texture = (slot->second < 0xFFFF) ? slot->second : 0xFFFF;
+    unsigned long long shader = (mode == SPRITES) ? 1 : 0;
+    unsigned long long primitive = (mode == LINES) ? 0 : ((mode == TRIANGLES) ? 1 : 2);
+    unsigned long long order = deferredCommands.size();
+
+    deferredKeys.push_back(((unsigned long long)currentLayer << 56) | (shader << 52) | (texture << 36) | (primitive << 32) | order);
+
+    DeferredCommand command;
+    command.mode = mode;
+    command.textureId = textureId;
+    command.first = first;
+    command.count = count;
+    command.label = breakLabel;
+    deferredCommands.push_back(command);
+}
+
+// LSD radix sort on 8 bit digits, digits shared by every key are skipped
+static void RadixSort(std::vector<unsigned long long> &keys, std::vector<unsigned long long> &scratch)
+{
+    size_t count = keys.size();
+    if (count < 2) return;
+
+    scratch.resize(count);
+    unsigned long long *src = keys.data();
+    unsigned long long *dst = scratch.data();
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t offsets[256] = { 0 };
+        for (size_t i = 0; i < count; i++) offsets[(src[i] >> shift) & 0xFF]++;
+        if (offsets[(src[0] >> shift) & 0xFF] == count) continue;
+
+        for (size_t digit = 0, total = 0; digit < 256; digit++)
+        {
+            size_t n = offsets[digit];
+            offsets[digit] = total;
+            total += n;
+        }
+        for (size_t i = 0; i < count; i++) dst[offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+        std::swap(src, dst);
+    }
+    if (src != keys.data()) keys.swap(scratch);
+}
+
+// Emit the recorded commands into the batch in sort key order
+void RenderBatch::ReplayDeferred()
+{
+    if (replaying || deferredCommands.empty()) return;
+
+    replaying = true;
+    const char *label = breakLabel;
+    bool transformed = transformRequired;
+    transformRequired = false;      // Recorded after the transform
+    if (autoReorder) ScheduleReorder();
+    RadixSort(deferredKeys, deferredScratch);
+    for (size_t i = 0; i < deferredKeys.size(); i++)
+    {
+        const DeferredCommand &command = deferredCommands[deferredKeys[i] & 0xFFFFFFFF];
+        breakLabel = command.label;
+        if (command.mode == SPRITES)
+        {
+            QuadInstance *instances = PushInstances(command.textureId, command.count);
+            memcpy(instances, &deferredInstances[command.first], command.count*sizeof(QuadInstance));
+        }
+        else
+        {
+            Vertex *vertices = Reserve(command.mode, command.textureId, command.count);
+            if (vertices == NULL) continue;
+            memcpy(vertices, &deferredVertices[command.first], command.count*sizeof(Vertex));
+            sdfSpan = (deferredVertices[command.first].slot & SHAPE_SDF_BIT) != 0;     // One command per span, read from the CPU copy
+            Commit();
+        }
+    }
+    breakLabel = label;
+    transformRequired = transformed;
+    replaying = false;
+
+    deferredCommands.clear();
+    deferredKeys.clear();
+    deferredVertices.clear();
+    deferredInstances.clear();
+    deferredTextures.clear();
+}
+
+void RenderBatch::SetDeferred(bool enable)
+{
+    if (enable == deferred) return;
+
+    ReplayDeferred();       // Recorded commands keep the scheduling they were recorded for
+    deferred = enable;
+}
+
+void RenderBatch::SetAutoReorder(bool enable)
+{
+    if (enable == autoReorder) return;
+
+    ReplayDeferred();
+    autoReorder = enable;
+}
+
+// Runs are cut to what the current buffer holds (whole primitives), Reserve() and PushInstances() flush when full
+void RenderBatch::Submit(const BatchRecorder *const *recorders, int count)
+{
+    const char *label = breakLabel;
+    bool transformed = transformRequired;
+    transformRequired = false;      // Recorders emit final positions
+    for (int r = 0; r < count; r++)
+    {
+        const std::vector<DeferredCommand> &commands = recorders[r]->GetCommands();
+        const Vertex *vertices = recorders[r]->GetVertices().data();
+        const QuadInstance *instances = recorders[r]->GetInstances().data();
+
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            const DeferredCommand &command = commands[i];
+            breakLabel = command.label;
+            if (command.mode == SPRITES)
+            {
+                if (instanceShaderId == 0)
+                {
+                    Log(1, "BATCH: Instanced sprites not available, %i recorded instances skipped", command.count);
+                    continue;
+                }
+
+                int maxInstances = vertexBuffer[currentBuffer].elementCount;
+                for (int first = 0, chunk = 0; first < command.count; first += chunk)
+                {
+                    int room = IsRecording() ? maxInstances : maxInstances - instanceCounter;
+                    chunk = (room > 0) ? room : maxInstances;
+                    if (chunk > command.count - first) chunk = command.count - first;
+
+                    memcpy(PushInstances(command.textureId, chunk), instances + command.first + first, chunk*sizeof(QuadInstance));
+                }
+            }
+            else
+            {
+                int unit = (command.mode == QUADS) ? 4 : ((command.mode == TRIANGLES) ? 3 : 2);
+                int capacity = vertexBuffer[currentBuffer].elementCount*4 - 4;
+                for (int first = 0, chunk = 0; first < command.count; first += chunk)
+                {
+                    int room = IsRecording() ? capacity : capacity - vertexCounter;
+                    chunk = (room >= unit) ? room : capacity;
+                    chunk -= chunk%unit;
+                    if (chunk > command.count - first) chunk = command.count - first;
+
+                    Vertex *span = Reserve(command.mode, command.textureId, chunk);
+                    if (span == NULL) break;
+                    memcpy(span, vertices + command.first + first, chunk*sizeof(Vertex));
+                    Commit();
+                }
+            }
+        }
+    }
+    breakLabel = label;
+    transformRequired = transformed;
+}
+
+// Conservative screen bounds of a recorded command
+// NOTE: Padded by one unit (one pixel with the usual screen ortho) for line rasterization and GPU trig precision
+static void GetCommandBounds(const DeferredCommand &command, const Vertex *vertices, const QuadInstance *instances, float *bounds)
 {
-    Color4ub((unsigned char)(r*255), (unsigned char)(g*255), (unsigned char)(b*255), (unsigned char)(a*255));
-}
+    float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+    if (command.mode == SPRITES)
+    {
+        for (int i = 0; i < command.count; i++)
+        {
+            const QuadInstance &instance = instances[command.first + i];
+            float x0 = -instance.originX, y0 = -instance.originY;
+            float x1 = x0 + instance.width, y1 = y0 + instance.height;
+            if (instance.rotation != 0.0f)
+            {
+                // Any rotation stays inside the circle around the pivot reaching the farthest corner
+                float dx = fmaxf(fabsf(x0), fabsf(x1));
+                float dy = fmaxf(fabsf(y0), fabsf(y1));
+                float radius = sqrtf(dx*dx + dy*dy);
+                x0 = y0 = -radius;
+                x1 = y1 = radius;
+            }
+            minX = fminf(minX, instance.x + fminf(x0, x1));
+            minY = fminf(minY, instance.y + fminf(y0, y1));
+            maxX = fmaxf(maxX, instance.x + fmaxf(x0, x1));
+            maxY = fmaxf(maxY, instance.y + fmaxf(y0, y1));
+        }
+    }
+    else
+    {
+        for (int i = 0; i < command.count; i++)
+        {
+            const Vector3 &position = vertices[command.first + i].position;
+            minX = fminf(minX, position.x);
+            minY = fminf(minY, position.y);
+            maxX = fmaxf(maxX, position.x);
+            maxY = fmaxf(maxY, position.y);
+        }
+    }
 
-void RenderBatch::setMatrix(const Matrix &matrix)
-{
-    this->matrix = matrix;
+    bounds[0] = minX - 1.0f;
+    bounds[1] = minY - 1.0f;
+    bounds[2] = maxX + 1.0f;
+    bounds[3] = maxY + 1.0f;
 }
 
- 
-void RenderBatch::Color3f(float x, float y, float z)
+static inline bool BoundsOverlap(const float *a, const float *b)
 {
-    Color4ub((unsigned char)(x*255), (unsigned char)(y*255), (unsigned char)(z*255), 255);
+    return (a[0] <= b[2]) && (b[0] <= a[2]) && (a[1] <= b[3]) && (b[1] <= a[3]);
 }
 
-void RenderBatch::SetTexture(unsigned int id)
+// Assign each recorded command to a draw group and rewrite the sort keys as group | submission order
+// A command joins the last group of its state (shader, texture, mode) unless an earlier command it
+// overlaps sits in a later group, then it opens a new one. Overlapping commands thus keep their
+// relative order and only disjoint ones move, so blending gives the same pixels as in-order drawing.
+void RenderBatch::ScheduleReorder()
 {
-    if (id == 0)
+    int count = (int)deferredCommands.size();
+    reorderBounds.resize(count*4);
+
+    float sceneMinX = 1e30f, sceneMinY = 1e30f, sceneMaxX = -1e30f, sceneMaxY = -1e30f;
+    for (int i = 0; i < count; i++)
     {
-        if (vertexCounter >=    vertexBuffer[currentBuffer]->elementCount*4)
-        {
-            Render();
-        }
+        float *bounds = &reorderBounds[i*4];
+        GetCommandBounds(deferredCommands[i], deferredVertices.data(), deferredInstances.data(), bounds);
+        sceneMinX = fminf(sceneMinX, bounds[0]);
+        sceneMinY = fminf(sceneMinY, bounds[1]);
+        sceneMaxX = fmaxf(sceneMaxX, bounds[2]);
+        sceneMaxY = fmaxf(sceneMaxY, bounds[3]);
     }
-    else
+
+    // Grid sized to the scene, cells no smaller than a typical sprite
+    float cellWidth = fmaxf((sceneMaxX - sceneMinX)/REORDER_GRID_SIZE, REORDER_MIN_CELL);
+    float cellHeight = fmaxf((sceneMaxY - sceneMinY)/REORDER_GRID_SIZE, REORDER_MIN_CELL);
+    reorderGrid.resize(REORDER_GRID_SIZE*REORDER_GRID_SIZE);
+    for (size_t i = 0; i < reorderGrid.size(); i++) reorderGrid[i].clear();
+    reorderLarge.clear();
+
+    std::unordered_map<unsigned long long, int> lastGroup;     // State -> last group with that state
+    int groupCount = 0;
+
+    for (int i = 0; i < count; i++)
     {
-        if (draws[drawCounter - 1]->textureId != id)
+        const float *bounds = &reorderBounds[i*4];
+        int cellX0 = std::min((int)((bounds[0] - sceneMinX)/cellWidth), REORDER_GRID_SIZE - 1);
+        int cellY0 = std::min((int)((bounds[1] - sceneMinY)/cellHeight), REORDER_GRID_SIZE - 1);
+        int cellX1 = std::min((int)((bounds[2] - sceneMinX)/cellWidth), REORDER_GRID_SIZE - 1);
+        int cellY1 = std::min((int)((bounds[3] - sceneMinY)/cellHeight), REORDER_GRID_SIZE - 1);
+        bool large = ((cellX1 - cellX0 + 1)*(cellY1 - cellY0 + 1)) > REORDER_LARGE_CELLS;
+
+        // Highest group among earlier commands this one overlaps: it must be drawn after them
+        int dependency = -1;
+        for (size_t k = 0; k < reorderLarge.size(); k++)
+        {
+            const ReorderEntry &entry = reorderLarge[k];
+            if ((entry.group > dependency) && BoundsOverlap(bounds, &reorderBounds[entry.command*4])) dependency = entry.group;
+        }
+        if (large) dependency = groupCount - 1;     // Too expensive to test precisely, acts as a barrier
+        else
         {
-            if (draws[drawCounter - 1]->vertexCount > 0)
+            for (int y = cellY0; y <= cellY1; y++)
             {
-                if (draws[drawCounter - 1]->mode == LINES) draws[drawCounter - 1]->vertexAlignment = ((draws[drawCounter - 1]->vertexCount < 4)? draws[drawCounter - 1]->vertexCount : draws[drawCounter - 1]->vertexCount%4);
-                else if (draws[drawCounter - 1]->mode == TRIANGLES) draws[drawCounter - 1]->vertexAlignment = ((draws[drawCounter - 1]->vertexCount < 4)? 1 : (4 - (draws[drawCounter - 1]->vertexCount%4)));
-                else draws[drawCounter - 1]->vertexAlignment = 0;
-
-                if (!CheckRenderBatchLimit(draws[drawCounter - 1]->vertexAlignment))
+                for (int x = cellX0; x <= cellX1; x++)
                 {
-                    vertexCounter += draws[drawCounter - 1]->vertexAlignment;
-                    drawCounter++;
+                    // Newest first, stop once nothing older can raise the dependency
+                    const std::vector<ReorderEntry> &cell = reorderGrid[y*REORDER_GRID_SIZE + x];
+                    for (int k = (int)cell.size() - 1; (k >= 0) && (cell[k].maxGroup > dependency); k--)
+                    {
+                        if ((cell[k].group > dependency) && BoundsOverlap(bounds, &reorderBounds[cell[k].command*4])) dependency = cell[k].group;
+                    }
                 }
             }
+        }
 
-            if (drawCounter >= BATCH_DRAWCALLS) Render();
+        unsigned long long state = (deferredKeys[i] >> 32) & 0xFFFFFF;     // shader | texture | mode
+        std::unordered_map<unsigned long long, int>::iterator last = lastGroup.find(state);
+        int group;
+        if ((last != lastGroup.end()) && (last->second >= dependency)) group = last->second;
+        else
+        {
+            group = groupCount++;
+            lastGroup[state] = group;
+        }
 
-            draws[drawCounter - 1]->textureId = id;
-            draws[drawCounter - 1]->vertexCount = 0;
+        ReorderEntry entry;
+        entry.command = i;
+        entry.group = group;
+        if (large) reorderLarge.push_back(entry);
+        else
+        {
+            for (int y = cellY0; y <= cellY1; y++)
+            {
+                for (int x = cellX0; x <= cellX1; x++)
+                {
+                    std::vector<ReorderEntry> &cell = reorderGrid[y*REORDER_GRID_SIZE + x];
+                    entry.maxGroup = cell.empty() ? group : std::max(group, cell.back().maxGroup);
+                    cell.push_back(entry);
+                }
+            }
         }
 
+        deferredKeys[i] = ((unsigned long long)group << 32) | (unsigned long long)i;
     }
 }
 
+// NOTE: Needs VERTEX_LAYOUT_DEFAULT, packed vertices have no slot
+void RenderBatch::SetMultiTexture(bool enable)
+{
+    int slots = enable ? maxTextureSlots : 1;
+    if (slots == textureSlots) return;
 
+    if (enable && multiShaderId == 0)
+    {
+        Log(1, "BATCH: Multi-texture batching not available (needs the default vertex layout), keeping one texture per draw");
+        return;
+    }
+    if (vertexBuffer.size() > 0) Render();      // Pending draws were built for the previous table size
+    textureSlots = slots;
+    textureSlot = 0;
+}
 
-void RenderBatch::End(void)
+void RenderBatch::SetLayer(int layer)
 {
-    currentDepth=0.0f;
-
-   // currentDepth += (1.0f/20000.0f);
+    if (layer < 0) layer = 0;
+    if (layer > 255) layer = 255;
+    currentLayer = layer;
 }
 
 
 void RenderBatch::DrawLine(int startPosX, int startPosY, int endPosX, int endPosY, const Color &color)
 {
-    Begin(LINES);
-        Color4ub(color.r, color.g, color.b, color.a);
-        Vertex2f((float)startPosX, (float)startPosY);
-        Vertex2f((float)endPosX, (float)endPosY);
-    End();
+    float bounds[4] = { (float)std::min(startPosX, endPosX), (float)std::min(startPosY, endPosY), (float)std::max(startPosX, endPosX), (float)std::max(startPosY, endPosY) };
+    if (IsCulled(bounds)) return;
+
+    Vertex *v = Reserve(LINES, 0, 2);
+    if (v == NULL) return;
+
+    PutVertex(v, (float)startPosX, (float)startPosY, currentDepth, color);
+    PutVertex(v, (float)endPosX, (float)endPosY, currentDepth, color);
+    Commit();
 }
 
 
@@ -721,6 +2636,9 @@ void RenderBatch::DrawCircleSector(const Vector2 &center, float radius, float st
 {
     if (radius <= 0.0f) radius = 0.1f;  // Avoid div by zero
 
+    float bounds[4] = { center.x - radius, center.y - radius, center.x + radius, center.y + radius };
+    if (IsCulled(bounds)) return;
+
     // Function expects (endAngle > startAngle)
     if (endAngle < startAngle)
     {
@@ -730,36 +2648,36 @@ void RenderBatch::DrawCircleSector(const Vector2 &center, float radius, float st
         endAngle = tmp;
     }
 
-    int minSegments = (int)ceilf((endAngle - startAngle)/90);
-
-    if (segments < minSegments)
+    if (UseShapeSdf())
     {
-        // Calculate the maximum angle between segments based on the error rate (usually 0.5f)
-        float th = acosf(2*powf(1 - SMOOTH_CIRCLE_ERROR_RATE/radius, 2) - 1);
-        segments = (int)((endAngle - startAngle)*ceilf(2*PI/th)/360);
-
-        if (segments <= 0) segments = minSegments;
+        if (endAngle > startAngle) DrawArcShape(center, radius, radius, 0.0f, startAngle, std::min(endAngle, startAngle + 360.0f), false, color);
+        return;
     }
 
-    float stepLength = (endAngle - startAngle)/(float)segments;
-    float angle = startAngle;
-
-
+    segments = GetArcSegments(radius, startAngle, endAngle, segments);
+    if (segments <= 0) return;
+    const Vector2 *arc = GetArc(startAngle, endAngle, segments);
 
+    // NOTE: Fan emitted as quads (center, p[i + 2], p[i + 1], p[i]): the quad indices make two fan triangles of each,
+    // 4 vertices per 2 segments instead of 6 (last quad degenerate on odd counts), and it shares draws with rectangles
+    // Spans of an even segment count, as many as the buffer takes
+    int chunk = (GetSpanCapacity()/4)*2;
+    for (int first = 0; first < segments; first += chunk)
+    {
+        int last = std::min(first + chunk, segments);
+        Vertex *v = Reserve(QUADS, 0, 4*((last - first + 1)/2));
+        if (v == NULL) return;
 
-    Begin(TRIANGLES);
-        for (int i = 0; i < segments; i++)
+        for (int i = first; i < last; i += 2)
         {
-            Color4ub(color.r, color.g, color.b, color.a);
-
-            Vertex2f(center.x, center.y);
-            Vertex2f(center.x + cosf(DEG2RAD*(angle + stepLength))*radius, center.y + sinf(DEG2RAD*(angle + stepLength))*radius);
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*radius, center.y + sinf(DEG2RAD*angle)*radius);
-
-            angle += stepLength;
+            int next = std::min(i + 2, last);
+            PutVertex(v, center.x, center.y, currentDepth, color);
+            PutVertex(v, center.x + arc[next].x*radius, center.y + arc[next].y*radius, currentDepth, color);
+            PutVertex(v, center.x + arc[i + 1].x*radius, center.y + arc[i + 1].y*radius, currentDepth, color);
+            PutVertex(v, center.x + arc[i].x*radius, center.y + arc[i].y*radius, currentDepth, color);
         }
-    End();
-
+        Commit();
+    }
 }
 
 
@@ -768,6 +2686,9 @@ void RenderBatch::DrawCircleSectorLines(const Vector2 &center, float radius, flo
 {
     if (radius <= 0.0f) radius = 0.1f;  // Avoid div by zero issue
 
+    float bounds[4] = { center.x - radius, center.y - radius, center.x + radius, center.y + radius };
+    if (IsCulled(bounds)) return;
+
     // Function expects (endAngle > startAngle)
     if (endAngle < startAngle)
     {
@@ -777,61 +2698,69 @@ void RenderBatch::DrawCircleSectorLines(const Vector2 &center, float radius, flo
         endAngle = tmp;
     }
 
-    int minSegments = (int)ceilf((endAngle - startAngle)/90);
-
-    if (segments < minSegments)
+    // NOTE: The SDF outline of a partial sector would close it with the radii, tessellated then
+    if (UseShapeSdf() && (endAngle - startAngle >= 360.0f))
     {
-        // Calculate the maximum angle between segments based on the error rate (usually 0.5f)
-        float th = acosf(2*powf(1 - SMOOTH_CIRCLE_ERROR_RATE/radius, 2) - 1);
-        segments = (int)((endAngle - startAngle)*ceilf(2*PI/th)/360);
-
-        if (segments <= 0) segments = minSegments;
+        DrawArcShape(center, radius, radius, 0.0f, 0.0f, 360.0f, true, color);
+        return;
     }
 
-    float stepLength = (endAngle - startAngle)/(float)segments;
-    float angle = startAngle;
+    segments = GetArcSegments(radius, startAngle, endAngle, segments);
+    if (segments <= 0) return;
+    const Vector2 *arc = GetArc(startAngle, endAngle, segments);
     bool showCapLines = false;
 
-    Begin(LINES);
-        if (showCapLines)
+    // Caps go with the first and last span
+    int chunk = (GetSpanCapacity() - 4)/2;
+    for (int first = 0; first < segments; first += chunk)
+    {
+        int last = std::min(first + chunk, segments);
+        bool startCap = showCapLines && (first == 0);
+        bool endCap = showCapLines && (last == segments);
+        Vertex *v = Reserve(LINES, 0, 2*(last - first) + (startCap ? 2 : 0) + (endCap ? 2 : 0));
+        if (v == NULL) return;
+
+        if (startCap)
         {
-            Color4ub(color.r, color.g, color.b, color.a);
-            Vertex2f(center.x, center.y);
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*radius, center.y + sinf(DEG2RAD*angle)*radius);
+            PutVertex(v, center.x, center.y, currentDepth, color);
+            PutVertex(v, center.x + arc[0].x*radius, center.y + arc[0].y*radius, currentDepth, color);
         }
 
-        for (int i = 0; i < segments; i++)
+        for (int i = first; i < last; i++)
         {
-            Color4ub(color.r, color.g, color.b, color.a);
-
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*radius, center.y + sinf(DEG2RAD*angle)*radius);
-            Vertex2f(center.x + cosf(DEG2RAD*(angle + stepLength))*radius, center.y + sinf(DEG2RAD*(angle + stepLength))*radius);
-
-            angle += stepLength;
+            PutVertex(v, center.x + arc[i].x*radius, center.y + arc[i].y*radius, currentDepth, color);
+            PutVertex(v, center.x + arc[i + 1].x*radius, center.y + arc[i + 1].y*radius, currentDepth, color);
         }
 
-        if (showCapLines)
+        if (endCap)
         {
-            Color4ub(color.r, color.g, color.b, color.a);
-            Vertex2f(center.x, center.y);
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*radius, center.y + sinf(DEG2RAD*angle)*radius);
+            PutVertex(v, center.x, center.y, currentDepth, color);
+            PutVertex(v, center.x + arc[segments].x*radius, center.y + arc[segments].y*radius, currentDepth, color);
         }
-    End();
+        Commit();
+    }
 }
 
 void RenderBatch::DrawCircleGradient(int centerX, int centerY, float radius, const Color &color1, const Color &color2)
 {
-    Begin(TRIANGLES);
-        for (int i = 0; i < 360; i += 10)
+    float bounds[4] = { centerX - radius, centerY - radius, centerX + radius, centerY + radius };
+    if (IsCulled(bounds)) return;
+
+    const int segments = CIRCLE_GRADIENT_SEGMENTS;
+    const Vector2 *arc = GetArc(0.0f, 360.0f, segments);
+
+    // Fan as quads, see DrawCircleSector()
+    Vertex *v = Reserve(QUADS, 0, 4*(segments/2));
+    if (v == NULL) return;
+
+        for (int i = 0; i < segments; i += 2)
         {
-            Color4ub(color1.r, color1.g, color1.b, color1.a);
-            Vertex2f((float)centerX, (float)centerY);
-            Color4ub(color2.r, color2.g, color2.b, color2.a);
-            Vertex2f((float)centerX + cosf(DEG2RAD*(i + 10))*radius, (float)centerY + sinf(DEG2RAD*(i + 10))*radius);
-            Color4ub(color2.r, color2.g, color2.b, color2.a);
-            Vertex2f((float)centerX + cosf(DEG2RAD*i)*radius, (float)centerY + sinf(DEG2RAD*i)*radius);
+            PutVertex(v, (float)centerX, (float)centerY, currentDepth, color1);
+            PutVertex(v, (float)centerX + arc[i + 2].x*radius, (float)centerY + arc[i + 2].y*radius, currentDepth, color2);
+            PutVertex(v, (float)centerX + arc[i + 1].x*radius, (float)centerY + arc[i + 1].y*radius, currentDepth, color2);
+            PutVertex(v, (float)centerX + arc[i].x*radius, (float)centerY + arc[i].y*radius, currentDepth, color2);
         }
-    End();
+    Commit();
 }
 
 
@@ -843,16 +2772,27 @@ void RenderBatch::DrawCircleLines(int centerX, int centerY, float radius, const
 
 void RenderBatch::DrawCircleLinesV(const Vector2 &center, float radius, const Color &color)
 {
-    Begin(LINES);
-        Color4ub(color.r, color.g, color.b, color.a);
+    float bounds[4] = { center.x - radius, center.y - radius, center.x + radius, center.y + radius };
+    if (IsCulled(bounds)) return;
+
+    if (UseShapeSdf())
+    {
+        DrawArcShape(center, radius, radius, 0.0f, 0.0f, 360.0f, true, color);
+        return;
+    }
+
+    const int segments = CIRCLE_GRADIENT_SEGMENTS;
+    const Vector2 *arc = GetArc(0.0f, 360.0f, segments);
+
+    Vertex *v = Reserve(LINES, 0, segments*2);
+    if (v == NULL) return;
 
-        // NOTE: Circle outline is drawn pixel by pixel every degree (0 to 360)
-        for (int i = 0; i < 360; i += 10)
+        for (int i = 0; i < segments; i++)
         {
-            Vertex2f(center.x + cosf(DEG2RAD*i)*radius, center.y + sinf(DEG2RAD*i)*radius);
-            Vertex2f(center.x + cosf(DEG2RAD*(i + 10))*radius, center.y + sinf(DEG2RAD*(i + 10))*radius);
+            PutVertex(v, center.x + arc[i].x*radius, center.y + arc[i].y*radius, currentDepth, color);
+            PutVertex(v, center.x + arc[i + 1].x*radius, center.y + arc[i + 1].y*radius, currentDepth, color);
         }
-    End();
+    Commit();
 }
 
 void RenderBatch::DrawCircle(int centerX, int centerY, float radius, const Color &color)
@@ -861,37 +2801,66 @@ void RenderBatch::DrawCircle(int centerX, int centerY, float radius, const Color
 }
 
 
+// NOTE: Segments from the screen radius (see SetViewport())
 void RenderBatch::DrawCircleV(const Vector2 &center, float radius, const Color &color)
 {
-    DrawCircleSector(center, radius, 0, 360, 36, color);
+    DrawCircleSector(center, radius, 0, 360, 0, color);
 }
 
 
 // Draw ellipse
 void RenderBatch::DrawEllipse(int centerX, int centerY, float radiusH, float radiusV, const Color &color)
 {
-    Begin(TRIANGLES);
-        for (int i = 0; i < 360; i += 10)
+    float bounds[4] = { centerX - fabsf(radiusH), centerY - fabsf(radiusV), centerX + fabsf(radiusH), centerY + fabsf(radiusV) };
+    if (IsCulled(bounds)) return;
+
+    if (UseShapeSdf())
+    {
+        DrawArcShape(Vector2((float)centerX, (float)centerY), radiusH, radiusV, 0.0f, 0.0f, 360.0f, false, color);
+        return;
+    }
+
+    const int segments = CIRCLE_GRADIENT_SEGMENTS;
+    const Vector2 *arc = GetArc(0.0f, 360.0f, segments);
+
+    // Fan as quads, see DrawCircleSector()
+    Vertex *v = Reserve(QUADS, 0, 4*(segments/2));
+    if (v == NULL) return;
+
+        for (int i = 0; i < segments; i += 2)
         {
-            Color4ub(color.r, color.g, color.b, color.a);
-            Vertex2f((float)centerX, (float)centerY);
-            Vertex2f((float)centerX + cosf(DEG2RAD*(i + 10))*radiusH, (float)centerY + sinf(DEG2RAD*(i + 10))*radiusV);
-            Vertex2f((float)centerX + cosf(DEG2RAD*i)*radiusH, (float)centerY + sinf(DEG2RAD*i)*radiusV);
+            PutVertex(v, (float)centerX, (float)centerY, currentDepth, color);
+            PutVertex(v, (float)centerX + arc[i + 2].x*radiusH, (float)centerY + arc[i + 2].y*radiusV, currentDepth, color);
+            PutVertex(v, (float)centerX + arc[i + 1].x*radiusH, (float)centerY + arc[i + 1].y*radiusV, currentDepth, color);
+            PutVertex(v, (float)centerX + arc[i].x*radiusH, (float)centerY + arc[i].y*radiusV, currentDepth, color);
         }
-    End();
+    Commit();
 }
 
 
 void RenderBatch::DrawEllipseLines(int centerX, int centerY, float radiusH, float radiusV, const Color &color)
 {
-    Begin(LINES);
-        for (int i = 0; i < 360; i += 10)
+    float bounds[4] = { centerX - fabsf(radiusH), centerY - fabsf(radiusV), centerX + fabsf(radiusH), centerY + fabsf(radiusV) };
+    if (IsCulled(bounds)) return;
+
+    if (UseShapeSdf())
+    {
+        DrawArcShape(Vector2((float)centerX, (float)centerY), radiusH, radiusV, 0.0f, 0.0f, 360.0f, true, color);
+        return;
+    }
+
+    const int segments = CIRCLE_GRADIENT_SEGMENTS;
+    const Vector2 *arc = GetArc(0.0f, 360.0f, segments);
+
+    Vertex *v = Reserve(LINES, 0, segments*2);
+    if (v == NULL) return;
+
+        for (int i = 0; i < segments; i++)
         {
-            Color4ub(color.r, color.g, color.b, color.a);
-            Vertex2f(centerX + cosf(DEG2RAD*(i + 10))*radiusH, centerY + sinf(DEG2RAD*(i + 10))*radiusV);
-            Vertex2f(centerX + cosf(DEG2RAD*i)*radiusH, centerY + sinf(DEG2RAD*i)*radiusV);
+            PutVertex(v, centerX + arc[i + 1].x*radiusH, centerY + arc[i + 1].y*radiusV, currentDepth, color);
+            PutVertex(v, centerX + arc[i].x*radiusH, centerY + arc[i].y*radiusV, currentDepth, color);
         }
-    End();
+    Commit();
 }
 
 
@@ -909,6 +2878,9 @@ void RenderBatch::DrawRing(const Vector2 &center, float innerRadius, float outer
         if (outerRadius <= 0.0f) outerRadius = 0.1f;
     }
 
+    float bounds[4] = { center.x - outerRadius, center.y - outerRadius, center.x + outerRadius, center.y + outerRadius };
+    if (IsCulled(bounds)) return;
+
     // Function expects (endAngle > startAngle)
     if (endAngle < startAngle)
     {
@@ -918,17 +2890,14 @@ void RenderBatch::DrawRing(const Vector2 &center, float innerRadius, float outer
         endAngle = tmp;
     }
 
-    int minSegments = (int)ceilf((endAngle - startAngle)/90);
-
-    if (segments < minSegments)
+    if (UseShapeSdf())
     {
-        // Calculate the maximum angle between segments based on the error rate (usually 0.5f)
-        float th = acosf(2*powf(1 - SMOOTH_CIRCLE_ERROR_RATE/outerRadius, 2) - 1);
-        segments = (int)((endAngle - startAngle)*ceilf(2*PI/th)/360);
-
-        if (segments <= 0) segments = minSegments;
+        DrawArcShape(center, outerRadius, outerRadius, std::max(innerRadius, 0.0f)/std::max(outerRadius, 0.1f), startAngle, std::min(endAngle, startAngle + 360.0f), false, color);
+        return;
     }
 
+    segments = GetArcSegments(outerRadius, startAngle, endAngle, segments);
+
     // Not a ring
     if (innerRadius <= 0.0f)
     {
@@ -936,26 +2905,26 @@ void RenderBatch::DrawRing(const Vector2 &center, float innerRadius, float outer
         return;
     }
 
-    float stepLength = (endAngle - startAngle)/(float)segments;
-    float angle = startAngle;
-
-    Begin(TRIANGLES);
-        for (int i = 0; i < segments; i++)
-        {
-            Color4ub(color.r, color.g, color.b, color.a);
-
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*innerRadius, center.y + sinf(DEG2RAD*angle)*innerRadius);
-            Vertex2f(center.x + cosf(DEG2RAD*(angle + stepLength))*innerRadius, center.y + sinf(DEG2RAD*(angle + stepLength))*innerRadius);
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*outerRadius, center.y + sinf(DEG2RAD*angle)*outerRadius);
+    if (segments <= 0) return;
+    const Vector2 *arc = GetArc(startAngle, endAngle, segments);
 
-            Vertex2f(center.x + cosf(DEG2RAD*(angle + stepLength))*innerRadius, center.y + sinf(DEG2RAD*(angle + stepLength))*innerRadius);
-            Vertex2f(center.x + cosf(DEG2RAD*(angle + stepLength))*outerRadius, center.y + sinf(DEG2RAD*(angle + stepLength))*outerRadius);
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*outerRadius, center.y + sinf(DEG2RAD*angle)*outerRadius);
+    // One quad per segment (outer[i], inner[i], inner[i + 1], outer[i + 1]), same triangles as the 6 vertex pair
+    int chunk = GetSpanCapacity()/4;
+    for (int first = 0; first < segments; first += chunk)
+    {
+        int last = std::min(first + chunk, segments);
+        Vertex *v = Reserve(QUADS, 0, 4*(last - first));
+        if (v == NULL) return;
 
-            angle += stepLength;
+        for (int i = first; i < last; i++)
+        {
+            PutVertex(v, center.x + arc[i].x*outerRadius, center.y + arc[i].y*outerRadius, currentDepth, color);
+            PutVertex(v, center.x + arc[i].x*innerRadius, center.y + arc[i].y*innerRadius, currentDepth, color);
+            PutVertex(v, center.x + arc[i + 1].x*innerRadius, center.y + arc[i + 1].y*innerRadius, currentDepth, color);
+            PutVertex(v, center.x + arc[i + 1].x*outerRadius, center.y + arc[i + 1].y*outerRadius, currentDepth, color);
         }
-    End();
-
+        Commit();
+    }
 }
 
 // Draw ring outline
@@ -973,6 +2942,9 @@ void RenderBatch::DrawRingLines(const Vector2 &center, float innerRadius, float
         if (outerRadius <= 0.0f) outerRadius = 0.1f;
     }
 
+    float bounds[4] = { center.x - outerRadius, center.y - outerRadius, center.x + outerRadius, center.y + outerRadius };
+    if (IsCulled(bounds)) return;
+
     // Function expects (endAngle > startAngle)
     if (endAngle < startAngle)
     {
@@ -982,55 +2954,56 @@ void RenderBatch::DrawRingLines(const Vector2 &center, float innerRadius, float
         endAngle = tmp;
     }
 
-    int minSegments = (int)ceilf((endAngle - startAngle)/90);
-
-    if (segments < minSegments)
+    if (UseShapeSdf() && ((innerRadius > 0.0f) || (endAngle - startAngle >= 360.0f)))
     {
-        // Calculate the maximum angle between segments based on the error rate (usually 0.5f)
-        float th = acosf(2*powf(1 - SMOOTH_CIRCLE_ERROR_RATE/outerRadius, 2) - 1);
-        segments = (int)((endAngle - startAngle)*ceilf(2*PI/th)/360);
-
-        if (segments <= 0) segments = minSegments;
+        DrawArcShape(center, outerRadius, outerRadius, std::max(innerRadius, 0.0f)/std::max(outerRadius, 0.1f), startAngle, std::min(endAngle, startAngle + 360.0f), true, color);
+        return;
     }
 
+    segments = GetArcSegments(outerRadius, startAngle, endAngle, segments);
+
     if (innerRadius <= 0.0f)
     {
         DrawCircleSectorLines(center, outerRadius, startAngle, endAngle, segments, color);
         return;
     }
 
-    float stepLength = (endAngle - startAngle)/(float)segments;
-    float angle = startAngle;
+    if (segments <= 0) return;
+    const Vector2 *arc = GetArc(startAngle, endAngle, segments);
     bool showCapLines = true;
 
-    Begin(LINES);
-        if (showCapLines)
+    // Caps go with the first and last span
+    int chunk = (GetSpanCapacity() - 4)/4;
+    for (int first = 0; first < segments; first += chunk)
+    {
+        int last = std::min(first + chunk, segments);
+        bool startCap = showCapLines && (first == 0);
+        bool endCap = showCapLines && (last == segments);
+        Vertex *v = Reserve(LINES, 0, 4*(last - first) + (startCap ? 2 : 0) + (endCap ? 2 : 0));
+        if (v == NULL) return;
+
+        if (startCap)
         {
-            Color4ub(color.r, color.g, color.b, color.a);
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*outerRadius, center.y + sinf(DEG2RAD*angle)*outerRadius);
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*innerRadius, center.y + sinf(DEG2RAD*angle)*innerRadius);
+            PutVertex(v, center.x + arc[0].x*outerRadius, center.y + arc[0].y*outerRadius, currentDepth, color);
+            PutVertex(v, center.x + arc[0].x*innerRadius, center.y + arc[0].y*innerRadius, currentDepth, color);
         }
 
-        for (int i = 0; i < segments; i++)
+        for (int i = first; i < last; i++)
         {
-            Color4ub(color.r, color.g, color.b, color.a);
-
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*outerRadius, center.y + sinf(DEG2RAD*angle)*outerRadius);
-            Vertex2f(center.x + cosf(DEG2RAD*(angle + stepLength))*outerRadius, center.y + sinf(DEG2RAD*(angle + stepLength))*outerRadius);
+            PutVertex(v, center.x + arc[i].x*outerRadius, center.y + arc[i].y*outerRadius, currentDepth, color);
+            PutVertex(v, center.x + arc[i + 1].x*outerRadius, center.y + arc[i + 1].y*outerRadius, currentDepth, color);
 
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*innerRadius, center.y + sinf(DEG2RAD*angle)*innerRadius);
-            Vertex2f(center.x + cosf(DEG2RAD*(angle + stepLength))*innerRadius, center.y + sinf(DEG2RAD*(angle + stepLength))*innerRadius);
-
-            angle += stepLength;
+            PutVertex(v, center.x + arc[i].x*innerRadius, center.y + arc[i].y*innerRadius, currentDepth, color);
+            PutVertex(v, center.x + arc[i + 1].x*innerRadius, center.y + arc[i + 1].y*innerRadius, currentDepth, color);
         }
 
-        if (showCapLines)
+        if (endCap)
         {
-            Color4ub(color.r, color.g, color.b, color.a);
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*outerRadius, center.y + sinf(DEG2RAD*angle)*outerRadius);
-            Vertex2f(center.x + cosf(DEG2RAD*angle)*innerRadius, center.y + sinf(DEG2RAD*angle)*innerRadius);
+            PutVertex(v, center.x + arc[segments].x*outerRadius, center.y + arc[segments].y*outerRadius, currentDepth, color);
+            PutVertex(v, center.x + arc[segments].x*innerRadius, center.y + arc[segments].y*innerRadius, currentDepth, color);
         }
-    End();
+        Commit();
+    }
 }
 
 
@@ -1055,6 +3028,10 @@ void RenderBatch::DrawRectangleRec(const Rectangle &rec, const Color &color)
 
 void RenderBatch::DrawRectanglePro(const Rectangle &rec, const Vector2 &origin, float rotation, const Color &color)
 {
+    float bounds[4];
+    GetSpriteBounds(rec, origin, rotation, bounds);
+    if (IsCulled(bounds)) return;
+
     Vector2 topLeft ;
     Vector2 topRight;
     Vector2 bottomLeft;
@@ -1092,19 +3069,16 @@ void RenderBatch::DrawRectanglePro(const Rectangle &rec, const Vector2 &origin,
         bottomRight.y = y + (dx + rec.width)*sinRotation + (dy + rec.height)*cosRotation;
     }
 
-    Begin(TRIANGLES);
+    // NOTE: Emitted as a quad so rectangles share a draw with textured quads (UI panels + icons)
+    Vertex *v = Reserve(QUADS, 0, 4);
+    if (v == NULL) return;
 
-        Color4ub(color.r, color.g, color.b, color.a);
+        PutVertex(v, topLeft.x, topLeft.y, currentDepth, color);
+        PutVertex(v, bottomLeft.x, bottomLeft.y, currentDepth, color);
+        PutVertex(v, bottomRight.x, bottomRight.y, currentDepth, color);
+        PutVertex(v, topRight.x, topRight.y, currentDepth, color);
 
-        Vertex2f(topLeft.x, topLeft.y);
-        Vertex2f(bottomLeft.x, bottomLeft.y);
-        Vertex2f(topRight.x, topRight.y);
-
-        Vertex2f(topRight.x, topRight.y);
-        Vertex2f(bottomLeft.x, bottomLeft.y);
-        Vertex2f(bottomRight.x, bottomRight.y);
-
-    End();
+    Commit();
 
 }
 
@@ -1112,21 +3086,25 @@ void RenderBatch::DrawRectanglePro(const Rectangle &rec, const Vector2 &origin,
 // NOTE: On OpenGL 3.3 and ES2 we use QUADS to avoid drawing order issues
 void RenderBatch::DrawRectangleLines(int posX, int posY, int width, int height, const Color &color)
 {
+    float bounds[4];
+    GetSpriteBounds(Rectangle(posX, posY, width, height), Vector2(0.0f, 0.0f), 0.0f, bounds);
+    if (IsCulled(bounds)) return;
 
-    Begin(LINES);
-        Color4ub(color.r, color.g, color.b, color.a);
-        Vertex2f(posX + 1, posY + 1);
-        Vertex2f(posX + width, posY + 1);
+    Vertex *v = Reserve(LINES, 0, 8);
+    if (v == NULL) return;
 
-        Vertex2f(posX + width, posY + 1);
-        Vertex2f(posX + width, posY + height);
+        PutVertex(v, posX + 1, posY + 1, currentDepth, color);
+        PutVertex(v, posX + width, posY + 1, currentDepth, color);
 
-        Vertex2f(posX + width, posY + height);
-        Vertex2f(posX + 1, posY + height);
+        PutVertex(v, posX + width, posY + 1, currentDepth, color);
+        PutVertex(v, posX + width, posY + height, currentDepth, color);
 
-        Vertex2f(posX + 1, posY + height);
-        Vertex2f(posX + 1, posY + 1);
-    End();
+        PutVertex(v, posX + width, posY + height, currentDepth, color);
+        PutVertex(v, posX + 1, posY + height, currentDepth, color);
+
+        PutVertex(v, posX + 1, posY + height, currentDepth, color);
+        PutVertex(v, posX + 1, posY + 1, currentDepth, color);
+    Commit();
 
 }
 
@@ -1151,12 +3129,92 @@ void RenderBatch::DrawRectangleLinesEx(const Rectangle &rec, float lineThick, co
     DrawRectangleRec(right, color);
 }
 
+// Rounded rectangle, corner radius roundness*min(width, height)/2 (segments per corner when tessellated)
+void RenderBatch::DrawRectangleRounded(const Rectangle &rec, float roundness, int segments, const Color &color)
+{
+    float radius = std::max(0.0f, std::min(roundness, 1.0f))*std::min(rec.width, rec.height)*0.5f;
+    if ((radius <= 0.0f) || (rec.width <= 0.0f) || (rec.height <= 0.0f))
+    {
+        DrawRectangleRec(rec, color);
+        return;
+    }
+
+    float bounds[4] = { rec.x, rec.y, rec.x + rec.width, rec.y + rec.height };
+    if (IsCulled(bounds)) return;
+
+    if (UseShapeSdf())
+    {
+        DrawRoundedShape(rec, radius, false, color);
+        return;
+    }
+
+    // Convex: one fan from the center as quads, see DrawCircleSector()
+    int count = GetRoundedOutline(rec, radius, segments);
+    Vector2 center(rec.x + rec.width*0.5f, rec.y + rec.height*0.5f);
+    int chunk = (GetSpanCapacity()/4)*2;
+    for (int first = 0; first < count; first += chunk)
+    {
+        int last = std::min(first + chunk, count);
+        Vertex *v = Reserve(QUADS, 0, 4*((last - first + 1)/2));
+        if (v == NULL) return;
+
+        for (int i = first; i < last; i += 2)
+        {
+            int next = std::min(i + 2, last);
+            PutVertex(v, center.x, center.y, currentDepth, color);
+            PutVertex(v, outlineScratch[next].x, outlineScratch[next].y, currentDepth, color);
+            PutVertex(v, outlineScratch[i + 1].x, outlineScratch[i + 1].y, currentDepth, color);
+            PutVertex(v, outlineScratch[i].x, outlineScratch[i].y, currentDepth, color);
+        }
+        Commit();
+    }
+}
+
+void RenderBatch::DrawRectangleRoundedLines(const Rectangle &rec, float roundness, int segments, const Color &color)
+{
+    float radius = std::max(0.0f, std::min(roundness, 1.0f))*std::min(rec.width, rec.height)*0.5f;
+    if ((radius <= 0.0f) || (rec.width <= 0.0f) || (rec.height <= 0.0f))
+    {
+        DrawRectangleLines((int)rec.x, (int)rec.y, (int)rec.width, (int)rec.height, color);
+        return;
+    }
+
+    float bounds[4] = { rec.x, rec.y, rec.x + rec.width, rec.y + rec.height };
+    if (IsCulled(bounds)) return;
+
+    if (UseShapeSdf())
+    {
+        DrawRoundedShape(rec, radius, true, color);
+        return;
+    }
+
+    int count = GetRoundedOutline(rec, radius, segments);
+    int chunk = GetSpanCapacity()/2;
+    for (int first = 0; first < count; first += chunk)
+    {
+        int last = std::min(first + chunk, count);
+        Vertex *v = Reserve(LINES, 0, 2*(last - first));
+        if (v == NULL) return;
+
+        for (int i = first; i < last; i++)
+        {
+            PutVertex(v, outlineScratch[i].x, outlineScratch[i].y, currentDepth, color);
+            PutVertex(v, outlineScratch[i + 1].x, outlineScratch[i + 1].y, currentDepth, color);
+        }
+        Commit();
+    }
+}
+
 
 void RenderBatch::DrawTexturePro(Texture2D &texture,  Rectangle &source, const Rectangle &dest, const Vector2 &origin, float rotation, const Color &tint)
 {
     // // Check if texture is valid
     if (texture.id > 0)
     {
+        float bounds[4];
+        GetSpriteBounds(dest, origin, rotation, bounds);
+        if (IsCulled(bounds)) return;
+
         float width  = (float)texture.width;
         float height = (float)texture.height;
 
@@ -1167,8 +3225,29 @@ void RenderBatch::DrawTexturePro(Texture2D &texture,  Rectangle &source, const R
         if (source.width < 0) { flipX = true; source.width *= -1; }
         if (source.height < 0) source.y -= source.height;
 
-
-        
+        if (CanInstance(texture.id))
+        {
+            float scaleU = texture.uvScale.x/width;
+            float scaleV = texture.uvScale.y/height;
+
+            // Built on the stack, the transform reads it back and the instance buffer may be mapped
+            QuadInstance instance;
+            instance.x = dest.x;
+            instance.y = dest.y;
+            instance.width = dest.width;
+            instance.height = dest.height;
+            instance.originX = origin.x;
+            instance.originY = origin.y;
+            instance.rotation = rotation*DEG2RAD;
+            instance.u0 = texture.uvOffset.x + (flipX ? (source.x + source.width) : source.x)*scaleU;
+            instance.u1 = texture.uvOffset.x + (flipX ? source.x : (source.x + source.width))*scaleU;
+            instance.v0 = texture.uvOffset.y + source.y*scaleV;
+            instance.v1 = texture.uvOffset.y + (source.y + source.height)*scaleV;
+            instance.color = tint;
+            if (transformRequired) TransformInstances(&instance, 1, transform);
+            *PushInstances(texture.id, 1) = instance;
+            return;
+        }
 
 
 
@@ -1210,37 +3289,95 @@ void RenderBatch::DrawTexturePro(Texture2D &texture,  Rectangle &source, const R
         }
     
 
-         SetTexture(texture.id);
-         Begin(QUADS);
+        // Padded array layers and atlas sprites: image texcoords scaled (and moved) into the layer or page
+        float left = texture.uvOffset.x + source.x/width*texture.uvScale.x;
+        float right = texture.uvOffset.x + (source.x + source.width)/width*texture.uvScale.x;
+        float top = texture.uvOffset.y + source.y/height*texture.uvScale.y;
+        float bottom = texture.uvOffset.y + (source.y + source.height)/height*texture.uvScale.y;
+        if (flipX) swap(left, right);
+
+        Vertex *v = Reserve(QUADS, texture.id, 4);
+        if (v == NULL) return;
+
+            PutVertex(v, topLeft.x, topLeft.y, currentDepth, left, top, tint, texture.layer);              // Top-left corner for texture and quad
+            PutVertex(v, bottomLeft.x, bottomLeft.y, currentDepth, left, bottom, tint, texture.layer);     // Bottom-left corner for texture and quad
+            PutVertex(v, bottomRight.x, bottomRight.y, currentDepth, right, bottom, tint, texture.layer);  // Bottom-right corner for texture and quad
+            PutVertex(v, topRight.x, topRight.y, currentDepth, right, top, tint, texture.layer);           // Top-right corner for texture and quad
+
+        Commit();
+
+     }
+}
+
+// Submit many sprites of one texture, split in spans that fit the current buffer
+void RenderBatch::DrawSprites(Texture2D &texture, const SpriteInstance *sprites, int count)
+{
+    if ((texture.id == 0) || (sprites == NULL) || (count <= 0)) return;
 
-         Color4ub(tint.r, tint.g, tint.b, tint.a);
-            
+    if (cullActive)
+    {
+        if ((int)cullScratch.size() < count) cullScratch.resize(count);
+        int visible = CullSprites(sprites, count, cullBounds, cullScratch.data(), GetSpritePath());
+        if (visible < count)
+        {
+            BATCH_STAT(frameStats.culled += count - visible);
+            sprites = cullScratch.data();
+            count = visible;
+            if (count == 0) return;
+        }
+    }
 
-            // Top-left corner for texture and quad
-            if (flipX) TexCoord2f((source.x + source.width)/width, source.y/height);
-            else TexCoord2f(source.x/width, source.y/height);
-            Vertex2f(topLeft.x, topLeft.y);
+    float invWidth = texture.uvScale.x/(float)texture.width;
+    float invHeight = texture.uvScale.y/(float)texture.height;
+    float offsetU = texture.uvOffset.x;
+    float offsetV = texture.uvOffset.y;
 
-            // Bottom-left corner for texture and quad
-            if (flipX) TexCoord2f((source.x + source.width)/width, (source.y + source.height)/height);
-            else TexCoord2f(source.x/width, (source.y + source.height)/height);
-            Vertex2f(bottomLeft.x, bottomLeft.y);
+    if (CanInstance(texture.id))
+    {
+        int maxInstances = vertexBuffer[currentBuffer].elementCount;
+        for (int first = 0, chunk = 0; first < count; first += chunk)
+        {
+            int room = maxInstances - instanceCounter;
+            chunk = (room > 0) ? room : maxInstances;
+            if (chunk > count - first) chunk = count - first;
 
-            // Bottom-right corner for texture and quad
-            if (flipX) TexCoord2f(source.x/width, (source.y + source.height)/height);
-            else TexCoord2f((source.x + source.width)/width, (source.y + source.height)/height);
-            Vertex2f(bottomRight.x, bottomRight.y);
+            QuadInstance *instances = PushInstances(texture.id, chunk);
+            if (!transformRequired)
+            {
+                SpritesToInstances(sprites + first, chunk, invWidth, invHeight, offsetU, offsetV, instances);
+                continue;
+            }
 
-            // Top-right corner for texture and quad
-            if (flipX) TexCoord2f(source.x/width, source.y/height);
-            else TexCoord2f((source.x + source.width)/width, source.y/height);
-            Vertex2f(topRight.x, topRight.y);
+            // Transformed in instanceStaging, the instance buffer may be mapped (write only)
+            if ((int)instanceStaging.size() < chunk) instanceStaging.resize(chunk);
+            SpritesToInstances(sprites + first, chunk, invWidth, invHeight, offsetU, offsetV, instanceStaging.data());
+            TransformInstances(instanceStaging.data(), chunk, transform);
+            memcpy(instances, instanceStaging.data(), chunk*sizeof(QuadInstance));
+        }
+        return;
+    }
 
-         End();
-        SetTexture(0);
+    SpritePath path = GetSpritePath();
+    int maxSprites = vertexBuffer[currentBuffer].elementCount - 1;
 
-     }
+    while (count > 0)
+    {
+        // Fill what is left of the current buffer first (minus worst case alignment), a full one after that
+        int room = (vertexBuffer[currentBuffer].elementCount*4 - vertexCounter - 4)/4;
+        int chunk = (room > 0) ? room : maxSprites;
+        if (chunk > count) chunk = count;
+
+        Vertex *v = Reserve(QUADS, texture.id, chunk*4);
+        if (v == NULL) return;
+
+        TransformSprites(sprites, chunk, invWidth, invHeight, offsetU, offsetV, currentDepth, texture.layer, v, path);
+        Commit();
+
+        sprites += chunk;
+        count -= chunk;
+    }
 }
+
 void RenderBatch::DrawTexture(Texture2D &texture, int posX, int posY, const Color &tint)
 {
     DrawTextureEx(texture, Vector2((float)posX, (float)posY ), 0.0f, 1.0f, tint);
@@ -1344,7 +3481,112 @@ bool Texture2D::LoadFromMemory(const unsigned char *fileData, int dataSize)
 
 void Texture2D::Release()
 {
-    if (id > 0) UnloadTexture(id);
+    if (id > 0 && !shared && !(id & TEXTURE_ARRAY_BIT)) UnloadTexture(id);    // Layers belong to their TextureArray
     id =0;
+    shared = false;
     
 }
+
+
+bool TextureArray::Create(int width, int height, int maxLayers)
+{
+    Release();
+
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, width, height, maxLayers);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    if (id == 0)
+    {
+        Log(2, "TEXTURE: Failed to create texture array");
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+    this->maxLayers = maxLayers;
+    layers = 0;
+    Log(0, "TEXTURE: [ID %i] Texture array created (%ix%i, %i layers)", id, width, height, maxLayers);
+    return true;
+}
+
+bool TextureArray::Load(const char *fileName, Texture2D &texture)
+{
+    unsigned int fileSize = 0;
+    unsigned char *fileData = LoadFileData(fileName, &fileSize);
+    if (fileData == NULL)
+    {
+        Log(2, "[%s] Texture could not be loaded", fileName);
+        return false;
+    }
+
+    int imageWidth = 0, imageHeight = 0, comp = 0;
+    unsigned char *pixels = stbi_load_from_memory(fileData, fileSize, &imageWidth, &imageHeight, &comp, 4);
+    free(fileData);
+    if (pixels == NULL)
+    {
+        Log(2, "[%s] Texture could not be loaded", fileName);
+        return false;
+    }
+
+    bool result = LoadFromPixels(pixels, imageWidth, imageHeight, texture);
+    stbi_image_free(pixels);
+    if (!result) Log(2, "[%s] Texture could not be placed in array", fileName);
+    return result;
+}
+
+bool TextureArray::LoadFromPixels(const unsigned char *pixels, int width, int height, Texture2D &texture)
+{
+    if (id == 0 || layers >= maxLayers)
+    {
+        Log(2, "TEXTURE: [ID %i] Texture array is full (%i layers)", id, maxLayers);
+        return false;
+    }
+    if (width > this->width || height > this->height || width <= 0 || height <= 0)
+    {
+        Log(2, "TEXTURE: [ID %i] Image %ix%i does not fit %ix%i layers", id, width, height, this->width, this->height);
+        return false;
+    }
+
+    // Pad to the layer size, one extruded texel so filtering at the image edge does not reach transparent padding
+    std::vector<unsigned char> layer(this->width*this->height*4, 0);
+    int paddedWidth = (width < this->width) ? width + 1 : width;
+    int paddedHeight = (height < this->height) ? height + 1 : height;
+    for (int y = 0; y < paddedHeight; y++)
+    {
+        const unsigned char *src = pixels + ((y < height) ? y : height - 1)*width*4;
+        unsigned char *dst = &layer[y*this->width*4];
+        memcpy(dst, src, width*4);
+        if (paddedWidth > width) memcpy(dst + width*4, src + (width - 1)*4, 4);
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layers, this->width, this->height, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data());
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    texture.Release();
+    texture.id = id | TEXTURE_ARRAY_BIT;
+    texture.width = width;
+    texture.height = height;
+    texture.format = R8G8B8A8;
+    texture.layer = layers;
+    texture.uvScale.set((float)width/(float)this->width, (float)height/(float)this->height);
+    texture.uvOffset.set(0.0f, 0.0f);
+
+    layers++;
+    return true;
+}
+
+void TextureArray::Release()
+{
+    if (id > 0) UnloadTexture(id);
+    id = 0;
+    layers = 0;
+}
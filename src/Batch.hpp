@@ -1,3 +1,5 @@
+#pragma once
+
 #include "pch.hpp"
 
 #define PI 3.14159265358979323846f
@@ -16,6 +18,30 @@ enum PixelFormat
 #define LINES                                0x0001     
 #define TRIANGLES                            0x0004      
 #define QUADS                                0x0008  
+#define SPRITES                              0x0010     // Instanced sprites: one QuadInstance per quad
+
+#define TEXTURE_ARRAY_BIT                0x80000000     // Set in texture ids naming a GL_TEXTURE_2D_ARRAY (TextureArray layers)
+#define BATCH_MAX_TEXTURE_SLOTS                  16     // Texture table size of a draw call (multi-texture batching)
+
+#define SHAPE_SDF_BIT                        0x8000     // Vertex slot flag: SDF shape quad, texcoord is the shape local position (no texture fetch)
+#define SHAPE_OUTLINE_BIT                    0x4000     // 1 pixel outline of the shape instead of its area
+#define SHAPE_ROUNDED_RECT_BIT               0x2000     // Rounded rectangle, else an arc (disc, ring, sector)
+#define SHAPE_PARAM_MASK                     0x0FFF     // Parameter A in the low slot bits (/4095), parameter B is the vertex layer (/65535)
+#define SHAPE_AA_MARGIN                        1.5f     // Pixels added around SDF quads for the anti-aliased edge and outlines
+
+#ifndef BATCH_STATS
+#define BATCH_STATS                               1     // 0 compiles the RenderStats counters out (they stay zero)
+#endif
+
+#if BATCH_STATS
+#define BATCH_STAT(x) x
+#else
+#define BATCH_STAT(x)
+#endif
+
+#define BATCH_STRINGIFY_(x) #x
+#define BATCH_STRINGIFY(x) BATCH_STRINGIFY_(x)
+#define BATCH_SITE(batch) (batch).SetBreakLabel(__FILE__ ":" BATCH_STRINGIFY(__LINE__))     // Label the next draws with this file:line
 
 struct Vector2
 {
@@ -164,6 +190,8 @@ struct Vertex
         color.g = 255;
         color.b = 255;
         color.a = 255;
+        layer = 0;
+        slot = 0;
     }
     Vertex(float x, float y, float z, float u, float v, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
     {
@@ -176,12 +204,74 @@ struct Vertex
         color.g = g;
         color.b = b;
         color.a = a;
+        layer = 0;
+        slot = 0;
     }
 
 
     Vector3 position;
     Vector2 texcoord;
     Color color;
+    unsigned short layer;       // Texture array layer (0 for plain textures)
+    unsigned short slot;        // Texture unit in the draw texture table (multi-texture batching)
+};
+
+
+// Packed 2D vertices (no z, texcoords as unorm16 in [0..1], so no REPEAT outside the texture)
+struct Vertex2D
+{
+    float x, y;
+    unsigned short u, v;
+    Color color;
+};                                  // 16 bytes
+
+struct Vertex2DHalf
+{
+    unsigned short x, y;            // Half-float position (exact integers up to 2048)
+    unsigned short u, v;
+    Color color;
+};                                  // 12 bytes
+
+struct Vertex2DShort
+{
+    short x, y;                     // Position rounded to whole pixels
+    unsigned short u, v;
+    Color color;
+};                                  // 12 bytes
+
+// GPU vertex format used by the batch buffers, selected on RenderBatch::Init()
+enum VertexLayout
+{
+    VERTEX_LAYOUT_DEFAULT = 0,      // Vertex: float xyz, float uv, rgba8, u16 layer + slot (28 bytes)
+    VERTEX_LAYOUT_2D,               // Vertex2D (16 bytes)
+    VERTEX_LAYOUT_2D_HALF,          // Vertex2DHalf (12 bytes)
+    VERTEX_LAYOUT_2D_SHORT,         // Vertex2DShort (12 bytes)
+};
+
+int GetLayoutStride(VertexLayout layout);
+void PackVertex(VertexLayout layout, unsigned char *dst, const Vertex &vertex);     // Write vertex at dst in layout
+
+// Compact per-sprite record expanded from a unit quad by the instanced shader (48 bytes vs 4*24)
+struct QuadInstance
+{
+    float x, y;                 // Destination position
+    float width, height;        // Destination size
+    float originX, originY;     // Origin (relative to destination, also rotation pivot)
+    float rotation;             // Rotation in radians
+    float u0, v0, u1, v1;       // Source rectangle in normalized texture coordinates
+    Color color;                // Tint
+};
+
+
+// One sprite for RenderBatch::DrawSprites(), same meaning as the DrawTexturePro() arguments
+// NOTE: Three 16 byte rows (dest, source, origin/rotation/tint) so SIMD paths can load and transpose them
+struct SpriteInstance
+{
+    Rectangle dest;             // Destination rectangle
+    Rectangle source;           // Source rectangle in texels (negative width/height flips)
+    Vector2 origin;             // Origin relative to dest, also the rotation pivot
+    float rotation;             // Rotation in degrees
+    Color tint;
 };
 
 
@@ -301,6 +391,78 @@ struct Matrix
     float m3, m7, m11, m15;     
 } ;
 
+// 2D affine transform (2x3 matrix): x' = a*x + c*y + tx, y' = b*x + d*y + ty (depth untouched)
+struct Transform2D
+{
+    Transform2D()
+    {
+        Identity();
+    }
+    Transform2D(float _a, float _b, float _c, float _d, float _tx, float _ty)
+    {
+        a = _a; b = _b; c = _c; d = _d; tx = _tx; ty = _ty;
+    }
+    void Identity()
+    {
+        a = 1.0f; b = 0.0f; c = 0.0f; d = 1.0f; tx = 0.0f; ty = 0.0f;
+    }
+    bool IsIdentity() const
+    {
+        return (a == 1.0f) && (b == 0.0f) && (c == 0.0f) && (d == 1.0f) && (tx == 0.0f) && (ty == 0.0f);
+    }
+    // Rotation and uniform scale only (no skew, no mirror): keeps SPRITES instances rectangles
+    bool IsConformal() const
+    {
+        return (a == d) && (b == -c) && (a*d - b*c > 0.0f);
+    }
+    float GetScale() const { return sqrtf(a*a + b*b); }             // Conformal transforms only
+    float GetRotation() const { return atan2f(b, a); }              // Radians, conformal transforms only
+
+    // mat applied first, then this one
+    Transform2D operator*(const Transform2D &mat) const
+    {
+        return Transform2D(a*mat.a + c*mat.b, b*mat.a + d*mat.b,
+                           a*mat.c + c*mat.d, b*mat.c + d*mat.d,
+                           a*mat.tx + c*mat.ty + tx, b*mat.tx + d*mat.ty + ty);
+    }
+    Vector2 Apply(float x, float y) const
+    {
+        return Vector2(a*x + c*y + tx, b*x + d*y + ty);
+    }
+    bool Invert(Transform2D &out) const
+    {
+        float det = a*d - b*c;
+        if (det == 0.0f) return false;
+        float inv = 1.0f/det;
+        out = Transform2D(d*inv, -b*inv, -c*inv, a*inv, (c*ty - d*tx)*inv, (b*tx - a*ty)*inv);
+        return true;
+    }
+    // AABB (minX, minY, maxX, maxY) of the transformed rect
+    void ApplyBounds(float minX, float minY, float maxX, float maxY, float *bounds) const
+    {
+        Vector2 p[4] = { Apply(minX, minY), Apply(maxX, minY), Apply(maxX, maxY), Apply(minX, maxY) };
+        bounds[0] = bounds[2] = p[0].x;
+        bounds[1] = bounds[3] = p[0].y;
+        for (int i = 1; i < 4; i++)
+        {
+            if (p[i].x < bounds[0]) bounds[0] = p[i].x;
+            if (p[i].x > bounds[2]) bounds[2] = p[i].x;
+            if (p[i].y < bounds[1]) bounds[1] = p[i].y;
+            if (p[i].y > bounds[3]) bounds[3] = p[i].y;
+        }
+    }
+    Matrix ToMatrix() const
+    {
+        return Matrix(a, c, 0.0f, tx,
+                      b, d, 0.0f, ty,
+                      0.0f, 0.0f, 1.0f, 0.0f,
+                      0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    float a, b, c, d;
+    float tx, ty;
+};
+
 struct Shader
 {
 
@@ -322,6 +484,10 @@ struct Texture2D
         width = 0;
         height = 0;
         format = PixelFormat::R8G8B8A8;
+        layer = 0;
+        uvScale.set(1.0f, 1.0f);
+        uvOffset.set(0.0f, 0.0f);
+        shared = false;
     }
     ~Texture2D()
     {
@@ -333,40 +499,152 @@ struct Texture2D
 
     void Release();
 
-    unsigned int id;        
+    unsigned int id;        // GL texture id, TEXTURE_ARRAY_BIT set for a TextureArray layer
     int width;              
     int height;              
     PixelFormat format;             
+    int layer;              // Layer in the TextureArray
+    Vector2 uvScale;        // Image size over layer (or atlas page) size
+    Vector2 uvOffset;       // Image position in the atlas page, normalized
+    bool shared;            // Handle to a texture owned by an AtlasBuilder, Release() leaves it alone
+};
+
+
+void UnloadTexture(unsigned int id);
+
+
+// Equal sized layers in one GL_TEXTURE_2D_ARRAY: sprites of any of its layers share a draw call
+// NOTE: Images smaller than the layer are padded (edge texels extruded once), so no REPEAT wrapping
+// NOTE: The layer travels in Vertex, packed vertex layouts have none and sample layer 0
+// NOTE: Owns its GL texture, copies are not allowed
+struct TextureArray
+{
+    TextureArray()
+    {
+        id = 0;
+        width = 0;
+        height = 0;
+        layers = 0;
+        maxLayers = 0;
+    }
+    ~TextureArray()
+    {
+        Release();
+    }
+
+    bool Create(int width, int height, int maxLayers);     // R8G8B8A8 layers
+    bool Load(const char *fileName, Texture2D &texture);   // Image into the next layer, texture becomes a handle to it
+    bool LoadFromPixels(const unsigned char *pixels, int width, int height, Texture2D &texture);  // R8G8B8A8 pixels
+
+    void Release();
+
+    unsigned int id;
+    int width;              // Layer size
+    int height;
+    int layers;             // Layers in use
+    int maxLayers;
+
+private:
+    TextureArray(const TextureArray &) = delete;
+    TextureArray &operator=(const TextureArray &) = delete;
 };
 
 
-// Dynamic vertex buffers (position + texcoords + colors + indices arrays)
+// How vertex data reaches the GPU buffers
+enum UploadMode
+{
+    UPLOAD_SUBDATA = 0,     // Emit into CPU arrays, copy with glBufferSubData() on Render()
+    UPLOAD_MAPPED,          // Emit straight into glMapBufferRange() memory, regions guarded by fences
+};
+
+// Dynamic vertex buffers (vertex data + instance data, quad indices are shared by the batch)
 struct VertexBuffer 
 {
     int elementCount;           // Number of elements in the buffer (QUADS)
-    std::vector<Vertex>  vertices;            // Vertex position (XYZ - 3 components per vertex) (shader-location = 0)
-    std::vector<unsigned int>  indices;    // Vertex indices (in case vertex data comes indexed) (6 indices per quad)
+    std::vector<unsigned char> vertices;      // Vertex data in the batch VertexLayout (position, texcoord, color)
     unsigned int vaoId;         // OpenGL Vertex Array Object id
     unsigned int vboId;      
-    unsigned int iboId;      
+    std::vector<QuadInstance> instances;    // Instanced sprite records (SPRITES mode)
+    unsigned int instanceVaoId;             // VAO: unit quad + per-instance attributes (divisor 1)
+    unsigned int instanceVboId;
+    GLsync fence;                           // Signaled when the GPU is done reading this buffer (UPLOAD_MAPPED)
 } ;
 
 struct DrawCall 
 {
-    int mode;                   // Drawing mode: LINES, TRIANGLES, QUADS
-    int vertexCount;            // Number of vertex of the draw
+    int mode;                   // Drawing mode: LINES, TRIANGLES, QUADS, SPRITES
+    int vertexCount;            // Number of vertex of the draw (number of instances for SPRITES)
     int vertexAlignment;        // Number of vertex required for index alignment (LINES, TRIANGLES)
     unsigned int textureId;     // Texture id to be used on the draw -> Use to create new draw call if changes
+    unsigned int textures[BATCH_MAX_TEXTURE_SLOTS];    // Texture table, unit = vertex slot (multi-texture batching)
+    int textureCount;           // Entries in textures, a draw closes only when it is full
 };
 
 
+// Draw recorded in deferred mode, replayed in sort key order by Render()
+struct DeferredCommand
+{
+    int mode;                   // LINES, TRIANGLES, QUADS or SPRITES
+    unsigned int textureId;
+    int first;                  // First vertex (first instance for SPRITES) in the deferred arrays
+    int count;
+    const char *label;          // Break label when recorded, restored on replay
+};
+
+
+// Why the batch closed a DrawCall (texture, mode) or submitted everything (the others)
+enum FlushReason
+{
+    FLUSH_BUFFER_FULL = 0,      // CheckRenderBatchLimit() / CheckInstanceLimit() overflow
+    FLUSH_TEXTURE,              // SetTexture() with another texture (or a full texture table)
+    FLUSH_MODE,                 // Begin() with another mode
+    FLUSH_RENDER,               // Render() called by the user (or a batch setting change)
+    FLUSH_STATIC,               // BeginStatic() / DrawStatic() with dynamic draws pending (keeps them in order)
+    FLUSH_REASON_COUNT
+};
+
+// Batch counters, see RenderBatch::GetFrameStats()
+struct RenderStats
+{
+    unsigned long long drawCalls;
+    unsigned long long vertices;            // LINES, TRIANGLES and QUADS vertices drawn
+    unsigned long long instances;           // SPRITES instances drawn
+    unsigned long long uploadBytes;         // Vertex and instance bytes sent to the GPU buffers
+    unsigned long long paddingVertices;     // Wasted by vertexAlignment (LINES, TRIANGLES draws followed by another draw)
+    unsigned long long culled;              // Draws (sprites, shapes) skipped by culling, see RenderBatch::SetCulling()
+    unsigned long long flushes[FLUSH_REASON_COUNT];
+};
+
+// Flushes of one reason under one break label, see RenderBatch::SetBreakTracking()
+struct BatchBreak
+{
+    const char *label;          // NULL: no label set
+    FlushReason reason;
+    unsigned int count;
+};
+
+
+// Command bounds in the reorder grid (auto reorder mode)
+struct ReorderEntry
+{
+    int command;
+    int group;                  // Draw group the command was scheduled into
+    int maxGroup;               // Highest group of this entry and the ones before it in the cell
+};
+
+
+struct SoftRasterizer;
+struct BatchRecorder;
+struct StaticBatch;
+struct StaticSegment;
+
 struct RenderBatch 
 {
  
     RenderBatch();
     ~RenderBatch();
 
-    void Init(int numBuffers, int bufferElements);
+    void Init(int numBuffers, int bufferElements, VertexLayout layout = VERTEX_LAYOUT_DEFAULT);
     void Release();
 
 
@@ -393,20 +671,52 @@ struct RenderBatch
     void DrawRectanglePro(const Rectangle &rec, const Vector2 &origin, float rotation, const Color &color);
     void DrawRectangleLines(int posX, int posY, int width, int height, const Color &color);
     void DrawRectangleLinesEx(const Rectangle &rec, float lineThick, const Color &color);
+    void DrawRectangleRounded(const Rectangle &rec, float roundness, int segments, const Color &color);         // Corner radius roundness*min(width, height)/2
+    void DrawRectangleRoundedLines(const Rectangle &rec, float roundness, int segments, const Color &color);
 
     void DrawTexture(Texture2D &texture, int posX, int posY, const Color &tint);
     void DrawTextureV(Texture2D &texture, const Vector2 &position, const Color &tint);
     void DrawTextureEx(Texture2D &texture,const  Vector2 &position, float rotation, float scale, const Color &tint);
     void DrawTextureRec(Texture2D &texture,  Rectangle &source, const Vector2 &position, const Color &tint);
     void DrawTexturePro(Texture2D &texture,  Rectangle &source, const Rectangle &dest, const Vector2 &origin, float rotation, const Color &tint);
+    void DrawSprites(Texture2D &texture, const SpriteInstance *sprites, int count);     // Bulk DrawTexturePro()
 
 
 
     void Render();
 
+    // Splice recorded draw lists in array order (see BatchRecorder), from the thread that owns the batch
+    void Submit(const BatchRecorder *const *recorders, int count);
+    void Submit(const BatchRecorder &recorder) { const BatchRecorder *list = &recorder; Submit(&list, 1); }
+
+    // Retained geometry: draws between BeginStatic() and EndStatic() go into target instead of the screen
+    // NOTE: Replaces what target held, buffers of the same size only get the bytes that changed
+    void BeginStatic(StaticBatch &target);
+    void EndStatic();
+    bool IsCapturing() const { return capture != NULL; }
+    void DrawStatic(StaticBatch &source, const Matrix *transform = NULL);  // Draws only, with matrix*GetTransform()*transform
+
     void Begin(int mode);                        
     void End(void);          
 
+    Vertex *Reserve(int mode, unsigned int textureId, int vertexCount);     // Writable span, NULL if it can never fit
+    int GetSpanCapacity() const;                 // Most vertices one Reserve() span holds
+    void Commit();
+    void SetTexture(unsigned int id);
+
+    // Texel rect sampled by untextured shapes instead of the default texture, e.g. a white texel in a sprite atlas
+    // NOTE: The texture must outlive its use here, TextureArray layers are not supported
+    void SetShapesTexture(const Texture2D &texture, const Rectangle &source);
+    void ResetShapesTexture();          // Back to the default 1x1 texture
+    unsigned int GetShapesTextureId() const { return shapesTextureId ? shapesTextureId : defaultTextureId; }
+
+    // SDF shapes: circles, ellipses, rings, sectors and rounded rectangles as one quad each, coverage evaluated per pixel
+    // (anti-aliased), in the open QUADS draw whatever its texture so they batch with sprites. Segment counts are ignored
+    // NOTE: VERTEX_LAYOUT_DEFAULT only (the shape goes in the layer and slot fields), packed layouts keep tessellating.
+    //       Gradient circles and partial sector outlines are always tessellated
+    void SetShapeSdf(bool enable) { shapeSdf = enable; }
+    bool IsShapeSdf() const { return shapeSdf; }
+
     void Vertex2i(int x, int y);                 
     void Vertex2f(float x, float y);          
     void Vertex3f(float x, float y, float z);     
@@ -418,29 +728,199 @@ struct RenderBatch
 
     void setMatrix(const Matrix &matrix);
 
+    // Matrix stack: draws are transformed by the top on emission (skipped while it is identity)
+    // NOTE: Translate(), Rotate() and Scale() act in local space (the last call applies first to the vertices)
+    // NOTE: Submit() and deferred replays take vertices as recorded, DrawStatic() applies the top on the GPU
+    void PushMatrix();
+    void PopMatrix();
+    void LoadIdentity();
+    void Translate(float x, float y);
+    void Rotate(float degrees);
+    void Scale(float x, float y);
+    void MultTransform(const Transform2D &mat);
+    const Transform2D &GetTransform() const { return transform; }
+
+    // Culling: emitters drop shapes and sprites whose bounds miss the cull rect, before any trig or vertex write
+    // NOTE: The rect is in world units, by default the area setMatrix() projects to the viewport (affine projections only)
+    // NOTE: Off while capturing a StaticBatch (replays may move it), immediate mode (Vertex3f()) and Submit() are never culled
+    void SetCulling(bool enable);
+    bool IsCulling() const { return culling; }
+    void SetCullRect(const Rectangle &rect);    // Explicit world rect, e.g. a camera view with margins
+    void ResetCullRect();                       // Back to the rect derived from setMatrix()
+
+    // Circles, sectors and rings passed less segments than needed pick them from their radius on screen (matrix stack
+    // and setMatrix() scale), with the viewport size in pixels. Until it is set world units count as pixels
+    void SetViewport(int width, int height);
+
+    void SetInstancing(bool enable);    // Emit textures as SPRITES instances instead of QUADS vertices
+    bool IsInstancing() const { return instancing; }
+
+    bool SetUploadMode(UploadMode mode);   // Flushes pending geometry before switching, false: mapping failed (stays UPLOAD_SUBDATA)
+    UploadMode GetUploadMode() const { return uploadMode; }
+
+    void SetQuadStrips(bool enable);       // Index QUADS as primitive-restart triangle strips
+    bool IsQuadStrips() const { return quadStrips; }
+
+    void SetRasterizer(SoftRasterizer *rasterizer);    // Render() draws on the CPU into rasterizer instead of GL (NULL: back to GL), UPLOAD_MAPPED writes the CPU copies meanwhile
+    SoftRasterizer *GetRasterizer() const { return rasterizer; }
+
+    void SetMultiTexture(bool enable);     // Bind up to GetTextureSlots() textures per draw, selected per vertex
+    bool IsMultiTexture() const { return textureSlots > 1; }
+    int GetTextureSlots() const { return maxTextureSlots; }
+
+    VertexLayout GetVertexLayout() const { return vertexLayout; }
+    int GetVertexStride() const { return vertexStride; }
+
+    void SetDeferred(bool enable);      // Record draws, sort them by state and emit them on Render()
+    bool IsDeferred() const { return deferred; }
+    void SetLayer(int layer);           // Deferred draw order, lower layers first (0..255)
+    int GetLayer() const { return currentLayer; }
+
+    void SetAutoReorder(bool enable);   // Record draws, group non-overlapping ones by state on Render() (same pixels, layers ignored)
+    bool IsAutoReorder() const { return autoReorder; }
+
+    const RenderStats &GetFrameStats() const { return frameStats; }     // Since the last ResetFrameStats()
+    const RenderStats &GetTotalStats() const { return totalStats; }     // Since Init(), up to the last ResetFrameStats()
+    void ResetFrameStats();             // Call once per frame: adds the frame to the totals and clears it
+
+    // Debug: count every flush (see FlushReason) under the label current when it happened
+    // NOTE: Labels are kept by pointer, use string literals (BATCH_SITE()) or strings alive until ResetFrameStats()
+    void SetBreakTracking(bool enable);
+    bool IsBreakTracking() const { return breakTracking; }
+    void SetBreakLabel(const char *label) { breakLabel = label; }
+    const std::vector<BatchBreak> &GetFrameBreaks() const { return frameBreaks; }  // Unsorted, cleared by ResetFrameStats()
+    void LogBreakReport(int maxEntries) const;      // Top breakers of the frame, most flushes first
+
 
     private:
         bool CheckRenderBatchLimit(int vCount);
-        void SetTexture(unsigned int id);
+        bool CheckInstanceLimit(int iCount);
+        void LoadQuadIndices();
+        bool MapBuffers();
+        void UnmapBuffers();
+        QuadInstance *PushInstances(unsigned int textureId, int count);
+        void RecordCommand(int mode, unsigned int textureId, int first, int count);
+        void ReplayDeferred();
+        void ScheduleReorder();
+        void SaveDrawState(DrawCall &state) const;
+        void RestoreDrawState(const DrawCall &state);
+        bool IsRecording() const { return (deferred || autoReorder) && !replaying; }
+        void Flush(FlushReason reason);     // Render() counted under reason
+        void SubmitRaster();
+        void DrawList(const DrawCall *list, int count, const VertexBuffer &buffer, bool instances, const Matrix &mvp);
+        void CaptureStatic();
+        void UploadStatic(StaticSegment &segment, const unsigned char *vertices, int vertexCount, const QuadInstance *instances, int instanceCount);
+        void ResetDraws();                  // Empty draw list, next buffer
+        void GrowDraws();
+        void CountFlush(FlushReason reason);
+        void SetTransform(const Transform2D &mat);
+        bool CanInstance(unsigned int textureId) const;
+        void UpdateCullBounds();
+        bool IsCulled(const float *bounds);
+        void UpdateLodScale();
+        int GetArcSegments(float radius, float startAngle, float endAngle, int segments);
+        const Vector2 *GetArc(float startAngle, float endAngle, int segments);
+        bool UseShapeSdf() const { return shapeSdf && (vertexLayout == VERTEX_LAYOUT_DEFAULT); }
+        unsigned int GetShapeTexture() const;
+        void DrawShapeQuad(const Vector2 &center, float extentX, float extentY, const Vector2 &axisX, const Vector2 &axisY, unsigned short shape, unsigned short param, const Color &color);
+        void DrawArcShape(const Vector2 &center, float radiusX, float radiusY, float innerRatio, float startAngle, float endAngle, bool outline, const Color &color);
+        void DrawRoundedShape(const Rectangle &rec, float radius, bool outline, const Color &color);
+        int GetRoundedOutline(const Rectangle &rec, float radius, int segments);
 
     int bufferCount;            // Number of vertex buffers (multi-buffering support)
     int currentBuffer;          // Current buffer tracking in case of multi-buffering
     int drawCounter;            // Draw calls counter
     float currentDepth;         // Current depth value for next draw
     int vertexCounter;
+    int instanceCounter;        // Instances recorded in the current buffer (SPRITES mode)
+    bool instancing;
+    UploadMode uploadMode;
+    bool mapped;                // Current buffer is mapped for writing
+    VertexLayout vertexLayout;
+    int vertexStride;           // Bytes per vertex for vertexLayout
+    unsigned char *vertexData;  // Write target: CPU array or mapped VBO of the current buffer
+    int reservedCount;          // Vertices of the open Reserve() span
+    bool reserveStaged;         // Open Reserve() span is reserveStaging, copied to vertexData on Commit()
+    std::vector<Vertex> reserveStaging;     // Reserve() span for compact layouts and transformed spans of a mapped buffer
+    std::vector<QuadInstance> instanceStaging;  // Transformed DrawSprites() instances of a mapped buffer
+    QuadInstance *instanceData;
     unsigned int defaultTextureId;  
     unsigned int defaultShaderId;
+    unsigned int instanceShaderId;
+    unsigned int quadVboId;     // Static unit quad shared by all instance VAOs
+    unsigned int quadIboId;     // Static quad indices shared by all vertex buffers
+    unsigned int indexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    int quadIndexCount;         // Number of quads covered by quadIboId
+    bool quadStrips;            // Quad indices as triangle strips + restart index
+
+    bool deferred;              // Draws are recorded and sorted until Render()
+    bool replaying;             // Deferred commands are being emitted into the batch
+    int currentLayer;
+    std::vector<DeferredCommand> deferredCommands;
+    std::vector<unsigned long long> deferredKeys;       // Sort keys, low 32 bits index deferredCommands
+    std::vector<unsigned long long> deferredScratch;    // Radix sort ping-pong buffer
+    std::vector<Vertex> deferredVertices;
+    std::vector<QuadInstance> deferredInstances;
+    std::unordered_map<unsigned int, int> deferredTextures;    // Texture id -> key slot, by first use in the frame
+
+    bool autoReorder;           // Replay recorded commands grouped by state, keeping overlapping ones in order
+    std::vector<std::vector<ReorderEntry> > reorderGrid;
+    std::vector<ReorderEntry> reorderLarge;     // Commands covering too many cells, tested against everything
+    std::vector<float> reorderBounds;           // minX, minY, maxX, maxY per command
 
     unsigned int mpvId;
     unsigned int textId;
-
-    std::vector<DrawCall*> draws;
-    std::vector<VertexBuffer*> vertexBuffer;
+    unsigned int instanceMpvId;
+    unsigned int instanceTextId;
+    unsigned int multiShaderId;     // Default shader picking the sampler by vertex slot
+    unsigned int multiMpvId;
+    int textureSlots;               // Table size in use, 1 when multi-texture batching is off
+    int maxTextureSlots;            // GL_MAX_TEXTURE_IMAGE_UNITS, clamped to BATCH_MAX_TEXTURE_SLOTS
+    int textureSlot;                // Slot of the current texture in the current draw table
+    FlushReason flushReason;        // Cause counted by the next Render()
+    RenderStats frameStats;
+    RenderStats totalStats;
+    bool breakTracking;
+    const char *breakLabel;
+    std::vector<BatchBreak> frameBreaks;
+    unsigned int arrayShaderId;     // Default shader sampling a GL_TEXTURE_2D_ARRAY by vertex layer
+    unsigned int arrayMpvId;
+    unsigned int arrayTextId;
+    unsigned int shapesTextureId;   // 0: shapes use defaultTextureId
+    float shapesU;                  // Texcoord stamped on shape spans, center of the shapes texel rect
+    float shapesV;
+    bool shapesSpan;                // Open Reserve() span takes the shapes texcoord on Commit()
+    bool sdfSpan;                   // Open Reserve() span is SDF shape quads, Commit() keeps their slot (shape bits)
+    SoftRasterizer *rasterizer;     // Not owned
+    StaticBatch *capture;           // BeginStatic() target, not owned
+    int captureSegments;            // Segments filled by this capture
+    UploadMode captureUploadMode;   // Restored by EndStatic(), captures go through the CPU arrays
+
+    std::vector<DrawCall> draws;            // drawCounter used, grows (never shrinks) when a buffer needs more draws
+    std::vector<VertexBuffer> vertexBuffer;
 
     float texcoordx, texcoordy;         
     unsigned char colorr, colorg, colorb, colora;
 
     Matrix matrix;   
+    Transform2D transform;                  // Top of the matrix stack
+    std::vector<Transform2D> transformStack;
+    bool transformRequired;                 // Top is not identity
+    bool transformConformal;                // Top keeps SPRITES instances rectangles (see Transform2D::IsConformal())
+    bool culling;
+    bool cullAuto;                          // Cull rect follows setMatrix()
+    Rectangle cullRect;                     // Explicit cull rect (world)
+    bool cullActive;                        // Culling on, valid rect, not capturing
+    float cullBounds[4];                    // Cull rect in the space of the transform top: minX, minY, maxX, maxY
+    std::vector<SpriteInstance> cullScratch;    // DrawSprites() survivors
+    int viewportWidth;                      // 0: world units are pixels (LOD)
+    int viewportHeight;
+    float lodScale;                         // Pixels per unit of the transform top
+    std::vector<unsigned short> circleSegments;         // Full circle segments by screen radius (ceil), 0: not computed yet
+    std::vector<std::vector<Vector2> > circleTables;    // Unit circle points (segments + 1) by segment count, built on first use
+    std::vector<Vector2> arcScratch;        // Partial arcs
+    std::vector<Vector2> outlineScratch;    // Tessellated rounded rectangle outline
+    bool shapeSdf;
 
 
     
@@ -0,0 +1,151 @@
+#include "BatchRecorder.hpp"
+#include "SpriteTransform.hpp"
+
+
+BatchRecorder::BatchRecorder()
+{
+    instancing = false;
+    breakLabel = NULL;
+}
+
+void BatchRecorder::Reset()
+{
+    commands.clear();
+    vertices.clear();
+    instances.clear();
+}
+
+// Grow the last command when the new run continues it
+bool BatchRecorder::Extend(int mode, unsigned int textureId, int first, int count)
+{
+    if (commands.empty()) return false;
+
+    DeferredCommand &last = commands.back();
+    if (last.mode != mode || last.textureId != textureId || last.label != breakLabel || last.first + last.count != first) return false;
+
+    last.count += count;
+    return true;
+}
+
+Vertex *BatchRecorder::Reserve(int mode, unsigned int textureId, int vertexCount)
+{
+    if (vertexCount <= 0) return NULL;
+
+    int first = (int)vertices.size();
+    if (!Extend(mode, textureId, first, vertexCount))
+    {
+        DeferredCommand command;
+        command.mode = mode;
+        command.textureId = textureId;
+        command.first = first;
+        command.count = vertexCount;
+        command.label = breakLabel;
+        commands.push_back(command);
+    }
+    vertices.resize(first + vertexCount);
+    return &vertices[first];
+}
+
+QuadInstance *BatchRecorder::PushInstances(unsigned int textureId, int count)
+{
+    if (count <= 0) return NULL;
+
+    int first = (int)instances.size();
+    if (!Extend(SPRITES, textureId, first, count))
+    {
+        DeferredCommand command;
+        command.mode = SPRITES;
+        command.textureId = textureId;
+        command.first = first;
+        command.count = count;
+        command.label = breakLabel;
+        commands.push_back(command);
+    }
+    instances.resize(first + count);
+    return &instances[first];
+}
+
+
+void BatchRecorder::DrawLine(int startPosX, int startPosY, int endPosX, int endPosY, const Color &color)
+{
+    Vertex *v = Reserve(LINES, 0, 2);
+    v[0] = Vertex((float)startPosX, (float)startPosY, 0.0f, 0.0f, 0.0f, color.r, color.g, color.b, color.a);
+    v[1] = Vertex((float)endPosX, (float)endPosY, 0.0f, 0.0f, 0.0f, color.r, color.g, color.b, color.a);
+}
+
+void BatchRecorder::DrawRectangle(int posX, int posY, int width, int height, const Color &color)
+{
+    DrawRectanglePro(Rectangle(posX, posY, width, height), Vector2(0.0f, 0.0f), 0.0f, color);
+}
+
+void BatchRecorder::DrawRectangleRec(const Rectangle &rec, const Color &color)
+{
+    DrawRectanglePro(rec, Vector2(0.0f, 0.0f), 0.0f, color);
+}
+
+// Same corners as a sprite with an empty source, the batch points the texcoords at the shapes texel
+void BatchRecorder::DrawRectanglePro(const Rectangle &rec, const Vector2 &origin, float rotation, const Color &color)
+{
+    SpriteInstance sprite;
+    sprite.dest = rec;
+    sprite.origin = origin;
+    sprite.rotation = rotation;
+    sprite.tint = color;
+    TransformSprites(&sprite, 1, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0, Reserve(QUADS, 0, 4), SPRITE_PATH_SCALAR);
+}
+
+
+void BatchRecorder::DrawTexture(const Texture2D &texture, int posX, int posY, const Color &tint)
+{
+    DrawTextureEx(texture, Vector2((float)posX, (float)posY), 0.0f, 1.0f, tint);
+}
+
+void BatchRecorder::DrawTextureV(const Texture2D &texture, const Vector2 &position, const Color &tint)
+{
+    DrawTextureEx(texture, position, 0.0f, 1.0f, tint);
+}
+
+void BatchRecorder::DrawTextureEx(const Texture2D &texture, const Vector2 &position, float rotation, float scale, const Color &tint)
+{
+    Rectangle source(0.0f, 0.0f, (float)texture.width, (float)texture.height);
+    Rectangle dest(position.x, position.y, (float)texture.width*scale, (float)texture.height*scale);
+
+    DrawTexturePro(texture, source, dest, Vector2(), rotation, tint);
+}
+
+void BatchRecorder::DrawTextureRec(const Texture2D &texture, const Rectangle &source, const Vector2 &position, const Color &tint)
+{
+    Rectangle dest(position.x, position.y, fabsf(source.width), fabsf(source.height));
+
+    DrawTexturePro(texture, source, dest, Vector2(), 0.0f, tint);
+}
+
+void BatchRecorder::DrawTexturePro(const Texture2D &texture, const Rectangle &source, const Rectangle &dest, const Vector2 &origin, float rotation, const Color &tint)
+{
+    SpriteInstance sprite;
+    sprite.dest = dest;
+    sprite.source = source;
+    sprite.origin = origin;
+    sprite.rotation = rotation;
+    sprite.tint = tint;
+    DrawSprites(texture, &sprite, 1);
+}
+
+// NOTE: No buffer limits here, RenderBatch::Submit() splits the runs to fit
+void BatchRecorder::DrawSprites(const Texture2D &texture, const SpriteInstance *sprites, int count)
+{
+    if ((texture.id == 0) || (sprites == NULL) || (count <= 0)) return;
+
+    float invWidth = texture.uvScale.x/(float)texture.width;
+    float invHeight = texture.uvScale.y/(float)texture.height;
+
+    // NOTE: QuadInstance has no layer, TextureArray layers always go through QUADS
+    if (instancing && !(texture.id & TEXTURE_ARRAY_BIT))
+    {
+        SpritesToInstances(sprites, count, invWidth, invHeight, texture.uvOffset.x, texture.uvOffset.y, PushInstances(texture.id, count));
+        return;
+    }
+
+    TransformSprites(sprites, count, invWidth, invHeight, texture.uvOffset.x, texture.uvOffset.y, 0.0f, (unsigned short)texture.layer,
+                     Reserve(QUADS, texture.id, count*4), GetSpritePath());
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Batch.hpp"
+
+// CPU only draw list, one per thread: no GL, no shared state, so worker threads record geometry side by side
+// RenderBatch::Submit() splices recorders into the GPU buffers in the order they are given, so the frame does not
+// depend on which thread finished first
+// NOTE: Commands keep the vertex layout independent Vertex (QuadInstance for SPRITES), packed by the batch on Submit()
+// NOTE: Texture id 0 takes the shapes texture of the batch at submit time (SetShapesTexture())
+// NOTE: Submit() leaves the recorder as it is, Reset() it before recording the next frame (or submit it again)
+struct BatchRecorder
+{
+    BatchRecorder();
+
+    void Reset();           // Drop the commands, keep the memory
+
+    // Writable run of vertices (instances), filled by the caller before the next call on this recorder
+    // NOTE: Runs of the same mode and texture are merged into one command
+    Vertex *Reserve(int mode, unsigned int textureId, int vertexCount);
+    QuadInstance *PushInstances(unsigned int textureId, int count);
+
+    void SetInstancing(bool enable) { instancing = enable; }   // Textures as SPRITES instances, match RenderBatch::IsInstancing()
+    bool IsInstancing() const { return instancing; }
+    void SetBreakLabel(const char *label) { breakLabel = label; }      // Break label of the next commands (BATCH_SITE())
+
+    void DrawLine(int startPosX, int startPosY, int endPosX, int endPosY, const Color &color);
+    void DrawRectangle(int posX, int posY, int width, int height, const Color &color);
+    void DrawRectangleRec(const Rectangle &rec, const Color &color);
+    void DrawRectanglePro(const Rectangle &rec, const Vector2 &origin, float rotation, const Color &color);
+
+    void DrawTexture(const Texture2D &texture, int posX, int posY, const Color &tint);
+    void DrawTextureV(const Texture2D &texture, const Vector2 &position, const Color &tint);
+    void DrawTextureEx(const Texture2D &texture, const Vector2 &position, float rotation, float scale, const Color &tint);
+    void DrawTextureRec(const Texture2D &texture, const Rectangle &source, const Vector2 &position, const Color &tint);
+    void DrawTexturePro(const Texture2D &texture, const Rectangle &source, const Rectangle &dest, const Vector2 &origin, float rotation, const Color &tint);
+    void DrawSprites(const Texture2D &texture, const SpriteInstance *sprites, int count);
+
+    const std::vector<DeferredCommand> &GetCommands() const { return commands; }
+    const std::vector<Vertex> &GetVertices() const { return vertices; }
+    const std::vector<QuadInstance> &GetInstances() const { return instances; }
+
+private:
+    bool Extend(int mode, unsigned int textureId, int first, int count);
+
+    std::vector<DeferredCommand> commands;      // first/count index vertices (instances for SPRITES)
+    std::vector<Vertex> vertices;
+    std::vector<QuadInstance> instances;
+    bool instancing;
+    const char *breakLabel;
+};
@@ -0,0 +1,168 @@
+#include "Bunnymark.hpp"
+
+Texture2D texture;
+Texture2D bunnyTextures[4];
+Texture2D bunnyLayers[4];
+TextureArray bunnyArray;
+Texture2D bunnySprites[4];
+Texture2D atlasWhite;
+AtlasBuilder bunnyAtlas;
+int textureSet = 0;
+RenderBatch batch;
+Vector2 mousePosition;
+Matrix ortho;
+bool bulkSubmit = false;
+bool mixedScene = false;
+JobSystem jobs;
+
+Bunny::Bunny()
+{
+    position = mousePosition;
+    speed.x = (float)Random_Float(-250, 250)/60.0f;
+    speed.y = (float)Random_Float(-250, 250)/60.0f;
+    color = Color((unsigned char)Random_Int(50, 240), (unsigned char)Random_Int(80, 240), (unsigned char)Random_Int(100, 240), 255);
+    kind = Random_Int(0, 3);
+}
+
+Texture2D &GetBunnyTexture(int kind)
+{
+    if (textureSet == 1) return bunnyTextures[kind];
+    if (textureSet == 2) return bunnyLayers[kind];
+    if (textureSet == 3) return bunnySprites[kind];
+    return texture;
+}
+
+void SubmitBulk(const std::vector<Bunny> &bunnies, std::vector<SpriteInstance> &sprites)
+{
+    sprites.resize(bunnies.size());
+    for (size_t i = 0; i < bunnies.size(); i++)
+    {
+        SpriteInstance &sprite = sprites[i];
+        sprite.dest = Rectangle(bunnies[i].position.x, bunnies[i].position.y, (float)texture.width, (float)texture.height);
+        sprite.source = Rectangle(0.0f, 0.0f, (float)texture.width, (float)texture.height);
+        sprite.rotation = 0.0f;
+        sprite.tint = bunnies[i].color;
+    }
+    BATCH_SITE(batch);
+    batch.DrawSprites(texture, sprites.data(), (int)sprites.size());
+}
+
+void RecordParallel(std::vector<Bunny> &bunnies, std::vector<BatchRecorder> &recorders)
+{
+    int count = (int)bunnies.size();
+    int slices = jobs.GetThreadCount()*JOB_SPLIT_FACTOR;
+    bool instancing = batch.IsInstancing();
+    if ((int)recorders.size() != slices) recorders.resize(slices);
+
+    JobCounter moved;
+    JobCounter recorded;
+    jobs.ParallelFor(count, 0, [&bunnies](int begin, int end)
+    {
+        for (int i = begin; i < end; i++) bunnies[i].Move();
+    }, &moved);
+
+    jobs.ParallelFor(slices, 1, [&bunnies, &recorders, count, slices, instancing](int begin, int end)
+    {
+        for (int slice = begin; slice < end; slice++)
+        {
+            BatchRecorder &recorder = recorders[slice];
+            recorder.Reset();
+            recorder.SetInstancing(instancing);
+            for (int i = count*slice/slices; i < count*(slice + 1)/slices; i++)
+            {
+                const Bunny &bunny = bunnies[i];
+                BATCH_SITE(recorder);
+                recorder.DrawTexture(GetBunnyTexture(bunny.kind), (int)bunny.position.x, (int)bunny.position.y, bunny.color);
+                BATCH_SITE(recorder);
+                if (mixedScene) recorder.DrawRectangle((int)bunny.position.x, (int)bunny.position.y - 4, 16, 2, bunny.color);
+            }
+        }
+    }, &recorded, &moved);
+
+    jobs.Wait(moved);
+    jobs.Wait(recorded);
+}
+
+void RecordSerial(std::vector<Bunny> &bunnies, std::vector<BatchRecorder> &recorders, std::vector<SpriteInstance> &sprites)
+{
+    recorders.resize(1);
+    BatchRecorder &recorder = recorders[0];
+    recorder.Reset();
+    recorder.SetInstancing(batch.IsInstancing());
+
+    sprites.resize(bulkSubmit ? bunnies.size() : 0);
+    for (size_t i = 0; i < bunnies.size(); i++)
+    {
+        Bunny &bunny = bunnies[i];
+        bunny.Move();
+        if (bulkSubmit)
+        {
+            sprites[i].dest = Rectangle(bunny.position.x, bunny.position.y, (float)texture.width, (float)texture.height);
+            sprites[i].source = Rectangle(0.0f, 0.0f, (float)texture.width, (float)texture.height);
+            sprites[i].rotation = 0.0f;
+            sprites[i].tint = bunny.color;
+            continue;
+        }
+        BATCH_SITE(recorder);
+        recorder.DrawTexture(GetBunnyTexture(bunny.kind), (int)bunny.position.x, (int)bunny.position.y, bunny.color);
+        BATCH_SITE(recorder);
+        if (mixedScene) recorder.DrawRectangle((int)bunny.position.x, (int)bunny.position.y - 4, 16, 2, bunny.color);
+    }
+    BATCH_SITE(recorder);
+    if (bulkSubmit) recorder.DrawSprites(texture, sprites.data(), (int)sprites.size());
+}
+
+void SubmitRecorders(std::vector<BatchRecorder> &recorders)
+{
+    std::vector<const BatchRecorder *> list(recorders.size());
+    for (size_t i = 0; i < recorders.size(); i++) list[i] = &recorders[i];
+    batch.Submit(list.data(), (int)list.size());
+}
+
+void SubmitParallel(std::vector<Bunny> &bunnies, std::vector<BatchRecorder> &recorders)
+{
+    RecordParallel(bunnies, recorders);
+    SubmitRecorders(recorders);
+}
+
+void LoadBunnyTextures()
+{
+    texture.Load("assets/wabbit_alpha.png");
+    bunnyArray.Create(64, 64, 4);
+    for (int i = 0; i < 4; i++)
+    {
+        bunnyTextures[i].Load("assets/wabbit_alpha.png");
+        bunnyArray.Load("assets/wabbit_alpha.png", bunnyLayers[i]);
+        bunnyAtlas.Add("assets/wabbit_alpha.png");
+    }
+    int white = bunnyAtlas.AddWhiteTexel();
+    bunnyAtlas.Build();
+    for (int i = 0; i < 4; i++) bunnyAtlas.GetSprite(i, bunnySprites[i]);
+    bunnyAtlas.GetSprite(white, atlasWhite);
+}
+
+void ReleaseBunnyTextures()
+{
+    texture.Release();
+    for (int i = 0; i < 4; i++)
+    {
+        bunnyTextures[i].Release();
+        bunnyLayers[i].Release();
+    }
+    bunnyArray.Release();
+    bunnyAtlas.Release();
+}
+
+void BuildBackdrop(StaticBatch &target, int highlight, const Color &tint)
+{
+    batch.BeginStatic(target);
+    for (int y = 0, tile = 0; y < (int)SCR_HEIGHT; y += 20)
+    {
+        for (int x = 0; x < (int)SCR_WIDTH; x += 20, tile++)
+        {
+            Color color(20 + x*60/SCR_WIDTH, 20, 30 + y*60/SCR_HEIGHT, 255);
+            batch.DrawRectangle(x + 1, y + 1, 18, 18, (tile == highlight) ? tint : color);
+        }
+    }
+    batch.EndStatic();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "utils.hpp"
+#include "Batch.hpp"
+#include "Atlas.hpp"
+#include "BatchRecorder.hpp"
+#include "JobSystem.hpp"
+#include "StaticBatch.hpp"
+
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+
+#define MAX_BATCH_ELEMENTS  8192
+
+// Scene shared by the window demo (main.cpp) and the headless runs (Headless.cpp)
+extern Texture2D texture;
+extern Texture2D bunnyTextures[4];     // Same image as four textures: a texture switch between most bunnies
+extern Texture2D bunnyLayers[4];       // Same image as four padded layers of bunnyArray
+extern TextureArray bunnyArray;
+extern Texture2D bunnySprites[4];      // Same image four times in bunnyAtlas
+extern Texture2D atlasWhite;           // White texel of bunnyAtlas, shapes texture of the atlas set
+extern AtlasBuilder bunnyAtlas;
+extern int textureSet;                 // 0: one texture, 1: four textures, 2: four array layers, 3: four atlas sprites
+extern RenderBatch batch;
+extern Vector2 mousePosition;          // Spawn point of new bunnies
+extern Matrix ortho;
+extern bool bulkSubmit;                // Bunnies go through DrawSprites() instead of one DrawTexture() each
+extern bool mixedScene;                // Interleave a rectangle after every bunny (texture/state switch per draw)
+extern JobSystem jobs;
+
+Texture2D &GetBunnyTexture(int kind);
+
+class Bunny
+{
+public:
+    Bunny();        // At mousePosition, random speed, tint and texture kind
+    void Move()
+    {
+        position.x += speed.x;
+        position.y += speed.y;
+        if (position.x > SCR_WIDTH) speed.x *= -1;
+        if (position.x < 0) speed.x *= -1;
+        if (position.y > SCR_HEIGHT) speed.y *= -1;
+        if (position.y < 0) speed.y *= -1;
+    }
+    void Update()
+    {
+        Move();
+
+
+        BATCH_SITE(batch);
+        if (!bulkSubmit) batch.DrawTexture(GetBunnyTexture(kind),position.x,position.y,color);
+        BATCH_SITE(batch);
+        if (mixedScene) batch.DrawRectangle((int)position.x, (int)position.y - 4, 16, 2, color);
+
+
+    }
+    Vector2 position;
+    Vector2 speed;
+    Color color;
+    int kind;
+};
+
+void LoadBunnyTextures();
+void ReleaseBunnyTextures();
+
+// All bunnies in one DrawSprites() call
+void SubmitBulk(const std::vector<Bunny> &bunnies, std::vector<SpriteInstance> &sprites);
+
+// Parallel frame: update phase, then emission phase into one recorder per range
+// NOTE: The vertex stream does not depend on the thread count (Submit() cuts the runs to the buffers the same way)
+void RecordParallel(std::vector<Bunny> &bunnies, std::vector<BatchRecorder> &recorders);
+
+// Same frame on this thread into one recorder (bulk mode: one DrawSprites())
+void RecordSerial(std::vector<Bunny> &bunnies, std::vector<BatchRecorder> &recorders, std::vector<SpriteInstance> &sprites);
+
+void SubmitRecorders(std::vector<BatchRecorder> &recorders);
+void SubmitParallel(std::vector<Bunny> &bunnies, std::vector<BatchRecorder> &recorders);
+
+// Tile grid captured once, tint: color of the tile at highlight (-1: none)
+void BuildBackdrop(StaticBatch &target, int highlight, const Color &tint);
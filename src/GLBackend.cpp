@@ -0,0 +1,439 @@
+#include "GLBackend.hpp"
+#include "utils.hpp"
+
+
+static GLBackend currentBackend = GL_BACKEND_NATIVE;
+static bool commandLog = true;
+static std::vector<GLCommand> commands;
+static GLCounters counters;
+
+// Recording state: object ids, CPU copies of the buffers (mapping, read back), current bindings
+static GLuint nextObject = 1;
+static std::unordered_map<GLuint, std::vector<unsigned char> > buffers;
+static GLuint arrayBuffer = 0;
+static GLuint elementBuffer = 0;
+static GLuint activeUnit = 0;
+static std::unordered_map<GLuint, GLTextureImage> textures;
+static GLuint boundTextures[16][2];         // Unit, GL_TEXTURE_2D / GL_TEXTURE_2D_ARRAY
+static char syncObject;
+
+
+static void Record(GLCommandType type, unsigned int target, unsigned int object, long long offset, long long bytes, int count, int instances)
+{
+    if (!commandLog) return;
+
+    GLCommand command;
+    command.type = type;
+    command.target = target;
+    command.object = object;
+    command.offset = offset;
+    command.bytes = bytes;
+    command.count = count;
+    command.instances = instances;
+    commands.push_back(command);
+}
+
+static GLuint &BoundBuffer(GLenum target)
+{
+    return (target == GL_ELEMENT_ARRAY_BUFFER) ? elementBuffer : arrayBuffer;
+}
+
+static GLuint &BoundTexture(GLenum target)
+{
+    return boundTextures[activeUnit & 15][(target == GL_TEXTURE_2D_ARRAY) ? 1 : 0];
+}
+
+// Image of the bound texture, created with the GL default wrap (GL_REPEAT)
+static GLTextureImage &TextureImage(GLenum target)
+{
+    std::unordered_map<GLuint, GLTextureImage>::iterator it = textures.find(BoundTexture(target));
+    if (it != textures.end()) return it->second;
+
+    GLTextureImage &image = textures[BoundTexture(target)];
+    image.repeatS = true;
+    image.repeatT = true;
+    return image;
+}
+
+static void GenObjects(GLsizei n, GLuint *ids)
+{
+    for (GLsizei i = 0; i < n; i++) ids[i] = nextObject++;
+}
+
+
+// Objects and queries
+//------------------------------------------------------------------------------------------------
+static const GLubyte *APIENTRY RecGetString(GLenum name)
+{
+    if (name == GL_VERSION) return (const GLubyte *)"OpenGL ES 3.2 (recording backend)";
+    if (name == GL_SHADING_LANGUAGE_VERSION) return (const GLubyte *)"OpenGL ES GLSL ES 3.20";
+    return (const GLubyte *)"Recording";
+}
+
+static void APIENTRY RecGetIntegerv(GLenum pname, GLint *data)
+{
+    *data = (pname == GL_MAX_TEXTURE_IMAGE_UNITS) ? 16 : 0;
+}
+
+static void APIENTRY RecGenBuffers(GLsizei n, GLuint *ids) { GenObjects(n, ids); }
+static void APIENTRY RecGenTextures(GLsizei n, GLuint *ids) { GenObjects(n, ids); }
+static void APIENTRY RecGenVertexArrays(GLsizei n, GLuint *ids) { GenObjects(n, ids); }
+static GLuint APIENTRY RecCreateShader(GLenum) { return nextObject++; }
+static GLuint APIENTRY RecCreateProgram(void) { return nextObject++; }
+
+static void APIENTRY RecDeleteBuffers(GLsizei n, const GLuint *ids)
+{
+    for (GLsizei i = 0; i < n; i++) buffers.erase(ids[i]);
+}
+
+static void APIENTRY RecDeleteTextures(GLsizei n, const GLuint *ids)
+{
+    for (GLsizei i = 0; i < n; i++) textures.erase(ids[i]);
+}
+
+static void APIENTRY RecDeleteObjects(GLsizei, const GLuint *) {}
+static void APIENTRY RecDeleteObject(GLuint) {}
+static void APIENTRY RecShaderSource(GLuint, GLsizei, const GLchar *const *, const GLint *) {}
+static void APIENTRY RecAttachShader(GLuint, GLuint) {}
+
+// Every shader compiles and links
+static void APIENTRY RecGetObjectiv(GLuint, GLenum pname, GLint *params)
+{
+    *params = (pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS) ? GL_TRUE : 0;
+}
+
+static void APIENTRY RecGetInfoLog(GLuint, GLsizei bufSize, GLsizei *length, GLchar *infoLog)
+{
+    if (length != NULL) *length = 0;
+    if (bufSize > 0 && infoLog != NULL) infoLog[0] = '\0';
+}
+
+static GLint APIENTRY RecGetUniformLocation(GLuint, const GLchar *) { return 0; }
+
+
+// State without effect on the log
+//------------------------------------------------------------------------------------------------
+static void APIENTRY RecEnum(GLenum) {}
+static void APIENTRY RecEnum2(GLenum, GLenum) {}
+static void APIENTRY RecPixelStorei(GLenum, GLint) {}
+static void APIENTRY RecClearColor(GLfloat, GLfloat, GLfloat, GLfloat) {}
+static void APIENTRY RecClear(GLbitfield) {}
+static void APIENTRY RecFinish(void) {}
+static void APIENTRY RecVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *) {}
+static void APIENTRY RecIndex(GLuint) {}
+static void APIENTRY RecIndex2(GLuint, GLuint) {}
+static void APIENTRY RecUniform1i(GLint, GLint) {}
+static void APIENTRY RecUniform1iv(GLint, GLsizei, const GLint *) {}
+static void APIENTRY RecUniformMatrix4fv(GLint, GLsizei, GLboolean, const GLfloat *) {}
+static GLsync APIENTRY RecFenceSync(GLenum, GLbitfield) { return (GLsync)&syncObject; }
+static void APIENTRY RecDeleteSync(GLsync) {}
+static GLenum APIENTRY RecClientWaitSync(GLsync, GLbitfield, GLuint64) { return GL_ALREADY_SIGNALED; }
+
+
+// Uploads
+//------------------------------------------------------------------------------------------------
+static void APIENTRY RecBindBuffer(GLenum target, GLuint buffer)
+{
+    BoundBuffer(target) = buffer;
+}
+
+static void APIENTRY RecBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum)
+{
+    std::vector<unsigned char> &storage = buffers[BoundBuffer(target)];
+    storage.resize(size);
+    if (data != NULL) memcpy(storage.data(), data, size);
+
+    counters.uploadBytes += (data != NULL) ? size : 0;
+    Record(GLCMD_BUFFER_DATA, target, BoundBuffer(target), 0, size, 0, 0);
+}
+
+static void APIENTRY RecBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+    std::vector<unsigned char> &storage = buffers[BoundBuffer(target)];
+    if ((size_t)(offset + size) > storage.size()) storage.resize(offset + size);
+    memcpy(storage.data() + offset, data, size);
+
+    counters.uploadBytes += size;
+    Record(GLCMD_BUFFER_SUBDATA, target, BoundBuffer(target), offset, size, 0, 0);
+}
+
+// NOTE: The mapping is the CPU copy itself, flushed ranges count as uploads
+static void *APIENTRY RecMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield)
+{
+    std::vector<unsigned char> &storage = buffers[BoundBuffer(target)];
+    if ((size_t)(offset + length) > storage.size()) return NULL;
+    return storage.data() + offset;
+}
+
+static void APIENTRY RecFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr length)
+{
+    counters.uploadBytes += length;
+    Record(GLCMD_BUFFER_FLUSH, target, BoundBuffer(target), offset, length, 0, 0);
+}
+
+static GLboolean APIENTRY RecUnmapBuffer(GLenum) { return GL_TRUE; }
+
+// Texture images are kept as R8G8B8A8 for the software rasterizer (see SoftRasterizer)
+// NOTE: Rows are read tightly packed, every upload sets GL_UNPACK_ALIGNMENT to 1
+static void APIENTRY RecTexImage2D(GLenum target, GLint level, GLint, GLsizei width, GLsizei height, GLint, GLenum format, GLenum, const void *pixels)
+{
+    int channels = (format == GL_RGBA) ? 4 : ((format == GL_RGB) ? 3 : ((format == GL_LUMINANCE_ALPHA) ? 2 : 1));
+    long long bytes = (pixels != NULL) ? (long long)width*height*channels : 0;
+    counters.uploadBytes += bytes;
+    Record(GLCMD_TEXTURE_DATA, target, BoundTexture(target), 0, bytes, 0, 0);
+
+    if (level != 0 || BoundTexture(target) == 0) return;
+
+    GLTextureImage &image = TextureImage(target);
+    image.width = width;
+    image.height = height;
+    image.layers = 1;
+    image.pixels.assign((size_t)width*height*4, 255);
+    if (pixels == NULL) return;
+
+    const unsigned char *src = (const unsigned char *)pixels;
+    unsigned char *dst = image.pixels.data();
+    for (int i = 0; i < width*height; i++, src += channels, dst += 4)
+    {
+        if (channels >= 3) memcpy(dst, src, 3);
+        else memset(dst, src[0], 3);
+        if (channels == 4) dst[3] = src[3];
+        else if (channels == 2) dst[3] = src[1];
+    }
+}
+
+static void APIENTRY RecTexStorage3D(GLenum target, GLsizei, GLenum, GLsizei width, GLsizei height, GLsizei depth)
+{
+    if (BoundTexture(target) == 0) return;
+
+    GLTextureImage &image = TextureImage(target);
+    image.width = width;
+    image.height = height;
+    image.layers = depth;
+    image.pixels.assign((size_t)width*height*depth*4, 0);
+}
+
+static void APIENTRY RecTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum, GLenum, const void *pixels)
+{
+    long long bytes = (long long)width*height*depth*4;
+    counters.uploadBytes += bytes;
+    Record(GLCMD_TEXTURE_DATA, target, BoundTexture(target), zoffset, bytes, 0, 0);
+
+    std::unordered_map<GLuint, GLTextureImage>::iterator it = textures.find(BoundTexture(target));
+    if (level != 0 || pixels == NULL || it == textures.end()) return;
+
+    // GL_RGBA only (TextureArray layers)
+    GLTextureImage &image = it->second;
+    const unsigned char *src = (const unsigned char *)pixels;
+    for (int z = zoffset; z < zoffset + depth && z < image.layers; z++)
+    {
+        for (int y = yoffset; y < yoffset + height && y < image.height; y++, src += width*4)
+        {
+            int count = (xoffset + width <= image.width) ? width : image.width - xoffset;
+            if (count > 0) memcpy(&image.pixels[(((size_t)z*image.height + y)*image.width + xoffset)*4], src, count*4);
+        }
+    }
+}
+
+static void APIENTRY RecTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+    std::unordered_map<GLuint, GLTextureImage>::iterator it = textures.find(BoundTexture(target));
+    if (it == textures.end()) return;
+
+    if (pname == GL_TEXTURE_WRAP_S) it->second.repeatS = (param == GL_REPEAT);
+    else if (pname == GL_TEXTURE_WRAP_T) it->second.repeatT = (param == GL_REPEAT);
+}
+
+
+// Binds and draws
+//------------------------------------------------------------------------------------------------
+static void APIENTRY RecActiveTexture(GLenum texture)
+{
+    activeUnit = texture - GL_TEXTURE0;
+}
+
+static void APIENTRY RecBindTexture(GLenum target, GLuint texture)
+{
+    BoundTexture(target) = texture;
+    if (texture == 0) return;       // Unbinds are not state changes worth counting
+    counters.textureBinds++;
+    Record(GLCMD_BIND_TEXTURE, target, texture | (activeUnit << 24), 0, 0, 0, 0);
+}
+
+static void APIENTRY RecUseProgram(GLuint program)
+{
+    if (program == 0) return;
+    counters.programBinds++;
+    Record(GLCMD_BIND_PROGRAM, 0, program, 0, 0, 0, 0);
+}
+
+static void APIENTRY RecBindVertexArray(GLuint array)
+{
+    if (array == 0) return;
+    Record(GLCMD_BIND_VERTEX_ARRAY, 0, array, 0, 0, 0, 0);
+}
+
+static void APIENTRY RecDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    counters.drawCalls++;
+    counters.vertices += count;
+    Record(GLCMD_DRAW_ARRAYS, mode, 0, first, 0, count, 0);
+}
+
+static void APIENTRY RecDrawElements(GLenum mode, GLsizei count, GLenum, const void *indices)
+{
+    counters.drawCalls++;
+    counters.vertices += count;
+    Record(GLCMD_DRAW_ELEMENTS, mode, elementBuffer, (long long)(size_t)indices, 0, count, 0);
+}
+
+static void APIENTRY RecDrawElementsInstanced(GLenum mode, GLsizei count, GLenum, const void *indices, GLsizei instancecount)
+{
+    counters.drawCalls++;
+    counters.vertices += count;
+    counters.instances += instancecount;
+    Record(GLCMD_DRAW_INSTANCED, mode, elementBuffer, (long long)(size_t)indices, 0, count, instancecount);
+}
+
+
+// Every entry point the batch, textures, shaders and the bunnymark use
+// NOTE: Anything else stays NULL, a crash there means a new call needs a recording function
+static void LoadRecordingFunctions()
+{
+    glad_glGetString = RecGetString;
+    glad_glGetIntegerv = RecGetIntegerv;
+    glad_glGenBuffers = RecGenBuffers;
+    glad_glGenTextures = RecGenTextures;
+    glad_glGenVertexArrays = RecGenVertexArrays;
+    glad_glCreateShader = RecCreateShader;
+    glad_glCreateProgram = RecCreateProgram;
+    glad_glDeleteBuffers = RecDeleteBuffers;
+    glad_glDeleteTextures = RecDeleteTextures;
+    glad_glDeleteVertexArrays = RecDeleteObjects;
+    glad_glDeleteShader = RecDeleteObject;
+    glad_glDeleteProgram = RecDeleteObject;
+    glad_glShaderSource = RecShaderSource;
+    glad_glCompileShader = RecDeleteObject;
+    glad_glAttachShader = RecAttachShader;
+    glad_glLinkProgram = RecDeleteObject;
+    glad_glGetShaderiv = RecGetObjectiv;
+    glad_glGetProgramiv = RecGetObjectiv;
+    glad_glGetShaderInfoLog = RecGetInfoLog;
+    glad_glGetProgramInfoLog = RecGetInfoLog;
+    glad_glGetUniformLocation = RecGetUniformLocation;
+
+    glad_glEnable = RecEnum;
+    glad_glDisable = RecEnum;
+    glad_glCullFace = RecEnum;
+    glad_glFrontFace = RecEnum;
+    glad_glDepthFunc = RecEnum;
+    glad_glBlendFunc = RecEnum2;
+    glad_glPixelStorei = RecPixelStorei;
+    glad_glTexParameteri = RecTexParameteri;
+    glad_glClearColor = RecClearColor;
+    glad_glClear = RecClear;
+    glad_glFinish = RecFinish;
+    glad_glVertexAttribPointer = RecVertexAttribPointer;
+    glad_glEnableVertexAttribArray = RecIndex;
+    glad_glVertexAttribDivisor = RecIndex2;
+    glad_glUniform1i = RecUniform1i;
+    glad_glUniform1iv = RecUniform1iv;
+    glad_glUniformMatrix4fv = RecUniformMatrix4fv;
+    glad_glTexStorage3D = RecTexStorage3D;
+    glad_glFenceSync = RecFenceSync;
+    glad_glDeleteSync = RecDeleteSync;
+    glad_glClientWaitSync = RecClientWaitSync;
+
+    glad_glBindBuffer = RecBindBuffer;
+    glad_glBufferData = RecBufferData;
+    glad_glBufferSubData = RecBufferSubData;
+    glad_glMapBufferRange = RecMapBufferRange;
+    glad_glFlushMappedBufferRange = RecFlushMappedBufferRange;
+    glad_glUnmapBuffer = RecUnmapBuffer;
+    glad_glTexImage2D = RecTexImage2D;
+    glad_glTexSubImage3D = RecTexSubImage3D;
+
+    glad_glActiveTexture = RecActiveTexture;
+    glad_glBindTexture = RecBindTexture;
+    glad_glUseProgram = RecUseProgram;
+    glad_glBindVertexArray = RecBindVertexArray;
+    glad_glDrawArrays = RecDrawArrays;
+    glad_glDrawElements = RecDrawElements;
+    glad_glDrawElementsInstanced = RecDrawElementsInstanced;
+
+    GLAD_GL_ES_VERSION_2_0 = 1;
+    GLAD_GL_ES_VERSION_3_0 = 1;
+    GLAD_GL_ES_VERSION_3_1 = 1;
+    GLAD_GL_ES_VERSION_3_2 = 1;
+}
+
+
+bool InitGLBackend(GLBackend backend, GLADloadproc loader)
+{
+    currentBackend = backend;
+
+    if (backend == GL_BACKEND_NATIVE)
+    {
+        if (loader == NULL || !gladLoadGLES2Loader(loader))
+        {
+            Log(2, "GL: Failed to load the GL functions");
+            return false;
+        }
+        return true;
+    }
+
+    LoadRecordingFunctions();
+    ResetGLCommands();
+    Log(0, "GL: Recording backend, no GPU calls are made");
+    return true;
+}
+
+GLBackend GetGLBackend()
+{
+    return currentBackend;
+}
+
+void SetGLCommandLog(bool enable)
+{
+    commandLog = enable;
+}
+
+const std::vector<GLCommand> &GetGLCommands()
+{
+    return commands;
+}
+
+const GLCounters &GetGLCounters()
+{
+    return counters;
+}
+
+void ResetGLCommands()
+{
+    commands.clear();
+    memset(&counters, 0, sizeof(GLCounters));
+}
+
+const GLTextureImage *GetGLTextureImage(unsigned int id)
+{
+    std::unordered_map<GLuint, GLTextureImage>::const_iterator it = textures.find(id);
+    return (it != textures.end()) ? &it->second : NULL;
+}
+
+const char *GetGLCommandName(GLCommandType type)
+{
+    switch (type)
+    {
+        case GLCMD_BUFFER_DATA: return "BufferData";
+        case GLCMD_BUFFER_SUBDATA: return "BufferSubData";
+        case GLCMD_BUFFER_FLUSH: return "FlushMappedBufferRange";
+        case GLCMD_TEXTURE_DATA: return "TextureData";
+        case GLCMD_BIND_TEXTURE: return "BindTexture";
+        case GLCMD_BIND_PROGRAM: return "UseProgram";
+        case GLCMD_BIND_VERTEX_ARRAY: return "BindVertexArray";
+        case GLCMD_DRAW_ARRAYS: return "DrawArrays";
+        case GLCMD_DRAW_ELEMENTS: return "DrawElements";
+        case GLCMD_DRAW_INSTANCED: return "DrawElementsInstanced";
+    }
+    return "Unknown";
+}
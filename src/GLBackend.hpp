@@ -0,0 +1,71 @@
+#pragma once
+
+#include "pch.hpp"
+
+// GL entry points used by RenderBatch, textures and shaders, all reached through glad's function pointers
+// NOTE: The recording backend fills those pointers with CPU functions, so the batch runs unchanged without a context
+
+enum GLBackend
+{
+    GL_BACKEND_NATIVE = 0,      // Driver functions from the loader (SDL_GL_GetProcAddress)
+    GL_BACKEND_RECORDING,       // No GPU: objects are ids, buffers live in CPU memory, calls go to the command log
+};
+
+enum GLCommandType
+{
+    GLCMD_BUFFER_DATA = 0,      // glBufferData(), bytes: size
+    GLCMD_BUFFER_SUBDATA,       // glBufferSubData(), bytes: size
+    GLCMD_BUFFER_FLUSH,         // glFlushMappedBufferRange(), bytes: mapped bytes written
+    GLCMD_TEXTURE_DATA,         // glTexImage2D(), glTexSubImage3D(), bytes: pixel bytes
+    GLCMD_BIND_TEXTURE,
+    GLCMD_BIND_PROGRAM,
+    GLCMD_BIND_VERTEX_ARRAY,
+    GLCMD_DRAW_ARRAYS,          // count: vertices
+    GLCMD_DRAW_ELEMENTS,        // count: indices
+    GLCMD_DRAW_INSTANCED,       // count: indices per instance, instances
+};
+
+struct GLCommand
+{
+    GLCommandType type;
+    unsigned int target;        // GL target or primitive mode
+    unsigned int object;        // Bound object, buffer of uploads, texture unit for GLCMD_BIND_TEXTURE in unit << 24
+    long long offset;           // Upload offset, first vertex, index byte offset
+    long long bytes;
+    int count;
+    int instances;
+};
+
+// Always kept by the recording backend, even with the log off
+struct GLCounters
+{
+    unsigned long long drawCalls;
+    unsigned long long vertices;        // DrawArrays vertices + DrawElements indices (per instance)
+    unsigned long long instances;
+    unsigned long long uploadBytes;     // Buffer and texture bytes
+    unsigned long long textureBinds;
+    unsigned long long programBinds;
+};
+
+// CPU copy of a texture kept by the recording backend, always R8G8B8A8 (GL_TEXTURE_2D_ARRAY layers one after the other)
+struct GLTextureImage
+{
+    int width;
+    int height;
+    int layers;                 // 1 for GL_TEXTURE_2D
+    bool repeatS;               // GL_REPEAT, clamp to edge otherwise
+    bool repeatT;
+    std::vector<unsigned char> pixels;
+};
+
+// Call once before any GL use (RenderBatch::Init(), Texture2D::Load()...)
+// NOTE: loader is only used by GL_BACKEND_NATIVE
+bool InitGLBackend(GLBackend backend, GLADloadproc loader);
+GLBackend GetGLBackend();
+
+void SetGLCommandLog(bool enable);      // Recording backend: keep every command (off: counters only, for throughput runs)
+const std::vector<GLCommand> &GetGLCommands();
+const GLCounters &GetGLCounters();
+void ResetGLCommands();                 // Clears the log and the counters
+const char *GetGLCommandName(GLCommandType type);
+const GLTextureImage *GetGLTextureImage(unsigned int id);      // Recording backend, NULL for unknown ids (and on native)
@@ -0,0 +1,535 @@
+#include "Headless.hpp"
+#include "Bunnymark.hpp"
+#include "GLBackend.hpp"
+#include "SoftRaster.hpp"
+#include "RenderThread.hpp"
+#include "StaticBatch.hpp"
+
+// Batch of the headless runs: recording backend, screen ortho, bunny textures
+static void InitHeadless()
+{
+    InitGLBackend(GL_BACKEND_RECORDING, NULL);
+    SetGLCommandLog(false);
+
+    batch.Init(12, MAX_BATCH_ELEMENTS);
+    ortho.Ortho(0,SCR_WIDTH,SCR_HEIGHT,0,-1,1);
+    batch.setMatrix(ortho);
+    batch.SetViewport(SCR_WIDTH, SCR_HEIGHT);
+    LoadBunnyTextures();
+}
+
+static void ReleaseHeadless()
+{
+    ReleaseBunnyTextures();
+    batch.Release();
+}
+
+// frame(i) then Render() for each frame, from a flushed batch with the frame stats and the GL counters reset
+// NOTE: Returns the seconds taken, the totals of the pass stay in batch.GetFrameStats() and GetGLCounters()
+template <typename Frame>
+static double TimePass(int frames, Frame frame)
+{
+    batch.Render();
+    batch.ResetFrameStats();
+    ResetGLCommands();
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < frames; i++)
+    {
+        frame(i);
+        batch.Render();
+    }
+    return (double)(SDL_GetPerformanceCounter() - start)/(double)SDL_GetPerformanceFrequency();
+}
+
+// Static batch: replayed frames upload nothing, edits upload only what changed
+// NOTE: Returns the number of failed checks
+static int CheckStaticBatch(int frames)
+{
+    int failures = 0;
+    StaticBatch grid;
+
+    batch.Render();
+    batch.ResetFrameStats();
+    ResetGLCommands();
+    BuildBackdrop(grid, -1, Color());
+    unsigned long long captureBytes = GetGLCounters().uploadBytes;
+
+    double seconds = TimePass(frames, [&grid](int frame)
+    {
+        Matrix shift(1.0f, 0.0f, 0.0f, (float)frame, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+        batch.DrawStatic(grid, &shift);
+    });
+    GLCounters replay = GetGLCounters();
+
+    // Tile 1 recolored in place (4 vertices), then a capture with tile 2 recolored instead (the span of tiles 1 and 2 at most)
+    Vertex tile[4];
+    Color red(255, 0, 0, 255);
+    tile[0] = Vertex(21.0f, 1.0f, 0.0f, 0.0f, 0.0f, red.r, red.g, red.b, red.a);
+    tile[1] = Vertex(21.0f, 19.0f, 0.0f, 0.0f, 0.0f, red.r, red.g, red.b, red.a);
+    tile[2] = Vertex(39.0f, 19.0f, 0.0f, 0.0f, 0.0f, red.r, red.g, red.b, red.a);
+    tile[3] = Vertex(39.0f, 1.0f, 0.0f, 0.0f, 0.0f, red.r, red.g, red.b, red.a);
+    ResetGLCommands();
+    grid.UpdateVertices(4, tile, 4);
+    batch.DrawStatic(grid);
+    unsigned long long editBytes = GetGLCounters().uploadBytes;
+
+    ResetGLCommands();
+    BuildBackdrop(grid, 2, red);
+    unsigned long long recaptureBytes = GetGLCounters().uploadBytes;
+
+    Log(0, "HEADLESS: static            %5i draws, %i KB captured, %7.2f us/frame %8.1f draw calls/frame %9.1f KB/frame, edit %llu bytes, recapture %llu bytes",
+        grid.GetDrawCount(), (int)(captureBytes/1024), seconds*1e6/frames, (double)replay.drawCalls/frames, (double)replay.uploadBytes/1024.0/frames,
+        editBytes, recaptureBytes);
+
+    if (replay.uploadBytes != 0 || replay.drawCalls != (unsigned long long)grid.GetDrawCount()*frames)
+    {
+        Log(2, "HEADLESS: static: %llu draw calls / %llu bytes for %i replays of %i draws", replay.drawCalls, replay.uploadBytes, frames, grid.GetDrawCount());
+        failures++;
+    }
+    if (editBytes != 4ull*batch.GetVertexStride() || recaptureBytes == 0 || recaptureBytes > 8ull*batch.GetVertexStride())
+    {
+        Log(2, "HEADLESS: static: edit uploaded %llu bytes, recapture %llu, one tile is %i", editBytes, recaptureBytes, 4*batch.GetVertexStride());
+        failures++;
+    }
+
+    grid.Release();
+    batch.ResetFrameStats();
+    return failures;
+}
+
+// Culling: still bunnies on a grid, zoomed 4x around the screen center, with and without culling (per sprite and bulk)
+// NOTE: Returns the number of failed checks, the visible/culled split must match the bunnies inside the zoomed view
+static int CheckCulling(int count, int frames)
+{
+    // Bunny i in grid cell i (wrapping), the half texel offset keeps every bound off the view edges
+    const int columns = SCR_WIDTH/20;
+    const int rows = SCR_HEIGHT/20;
+    const float view[4] = { SCR_WIDTH*3/8.0f, SCR_HEIGHT*3/8.0f, SCR_WIDTH*5/8.0f, SCR_HEIGHT*5/8.0f };     // Screen seen through the zoom
+
+    Random_Seed(1);
+    mousePosition.set(SCR_WIDTH/2.0f, SCR_HEIGHT/2.0f);
+    std::vector<Bunny> bunnies(count);
+    std::vector<SpriteInstance> sprites;
+    unsigned long long inside = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Bunny &bunny = bunnies[i];
+        bunny.position.set(10.5f + 20.0f*(i % columns), 10.5f + 20.0f*((i/columns) % rows));
+        bunny.speed.set(0.0f, 0.0f);
+        if (bunny.position.x + texture.width >= view[0] && bunny.position.x <= view[2] &&
+            bunny.position.y + texture.height >= view[1] && bunny.position.y <= view[3]) inside++;
+    }
+    unsigned long long expectedVertices = inside*4*frames;
+    unsigned long long expectedCulled = ((unsigned long long)count - inside)*frames;
+
+    int failures = 0;
+    for (int bulk = 0; bulk < 2; bulk++)
+    {
+        unsigned long long vertices[2] = { 0, 0 };
+        unsigned long long culled[2] = { 0, 0 };
+        double seconds[2] = { 0.0, 0.0 };
+        bulkSubmit = (bulk == 1);
+
+        for (int pass = 0; pass < 2; pass++)
+        {
+            batch.SetCulling(pass == 1);
+            seconds[pass] = TimePass(frames, [&bunnies, &sprites](int)
+            {
+                batch.PushMatrix();
+                batch.Translate(SCR_WIDTH/2.0f, SCR_HEIGHT/2.0f);
+                batch.Scale(4.0f, 4.0f);
+                batch.Translate(-(SCR_WIDTH/2.0f), -(SCR_HEIGHT/2.0f));
+                for (size_t i = 0; i < bunnies.size(); i++) bunnies[i].Update();
+                if (bulkSubmit) SubmitBulk(bunnies, sprites);
+                batch.PopMatrix();
+            });
+
+            const RenderStats &stats = batch.GetFrameStats();
+            vertices[pass] = stats.vertices;
+            culled[pass] = stats.culled;
+        }
+
+        Log(0, "HEADLESS: culled %-8s %8.2f ms/frame -> %6.2f ms/frame, %llu -> %llu vertices, %llu culled",
+            bulkSubmit ? "bulk" : "sprites", seconds[0]*1000.0/frames, seconds[1]*1000.0/frames, vertices[0], vertices[1], culled[1]);
+
+        if (culled[0] != 0 || vertices[0] != (unsigned long long)count*4*frames || culled[1] != expectedCulled || vertices[1] != expectedVertices)
+        {
+            Log(2, "HEADLESS: culled %s: %llu -> %llu vertices, %llu culled, expected %llu -> %llu vertices, %llu culled", bulkSubmit ? "bulk" : "sprites",
+                vertices[0], vertices[1], culled[1], (unsigned long long)count*4*frames, expectedVertices, expectedCulled);
+            failures++;
+        }
+    }
+
+    bulkSubmit = false;
+    batch.SetCulling(true);
+    batch.ResetFrameStats();
+    return failures;
+}
+
+// Particle scene of small circles and a few rings: fixed 36 segments, segments from the screen radius, then SDF quads
+// NOTE: Returns the number of failed checks
+static int CheckCircles(int frames)
+{
+    const int count = 10000;
+    std::vector<Vector2> centers(count);
+    std::vector<float> radii(count);
+    Random_Seed(7);
+    for (int i = 0; i < count; i++)
+    {
+        centers[i].set((float)Random_Float(0, SCR_WIDTH), (float)Random_Float(0, SCR_HEIGHT));
+        radii[i] = (i % 50 == 0) ? (float)Random_Float(20, 60) : (float)Random_Float(1, 6);
+    }
+
+    unsigned long long vertices[3] = { 0, 0, 0 };
+    double seconds[3] = { 0.0, 0.0, 0.0 };
+    int failures = 0;
+
+    for (int pass = 0; pass < 3; pass++)
+    {
+        int segments = (pass == 0) ? 36 : 0;
+        batch.SetShapeSdf(pass == 2);
+        seconds[pass] = TimePass(frames, [&centers, &radii, segments](int)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                Color color(100 + i % 150, 80, 200, 255);
+                if (i % 50 == 0) batch.DrawRing(centers[i], radii[i]*0.6f, radii[i], 0, 360, segments, color);
+                else batch.DrawCircleSector(centers[i], radii[i], 0, 360, segments, color);
+            }
+        });
+        vertices[pass] = batch.GetFrameStats().vertices;
+    }
+
+    Log(0, "HEADLESS: circles %5i     %8.2f ms/frame -> %6.2f ms/frame -> %6.2f ms/frame (sdf), %.1f -> %.1f -> %.1f vertices/circle (36 segment triangle list: 108)",
+        count, seconds[0]*1000.0/frames, seconds[1]*1000.0/frames, seconds[2]*1000.0/frames,
+        (double)vertices[0]/frames/count, (double)vertices[1]/frames/count, (double)vertices[2]/frames/count);
+
+    if (vertices[1] == 0 || vertices[1] >= vertices[0])
+    {
+        Log(2, "HEADLESS: circles: %llu vertices with 36 segments, %llu from the screen radius", vertices[0], vertices[1]);
+        failures++;
+    }
+    if (vertices[2] != (unsigned long long)count*4*frames)
+    {
+        Log(2, "HEADLESS: circles: %llu SDF vertices, expected 4 per circle (%llu)", vertices[2], (unsigned long long)count*4*frames);
+        failures++;
+    }
+
+    // Circles between sprites of one texture: SDF quads ride the sprites draw, tessellated fans switch to the shapes texture
+    unsigned long long drawCalls[2] = { 0, 0 };
+    for (int pass = 0; pass < 2; pass++)
+    {
+        batch.SetShapeSdf(pass == 1);
+        TimePass(1, [&centers, &radii](int)
+        {
+            for (int i = 0; i < 1000; i++)
+            {
+                batch.DrawTexture(texture, (int)centers[i].x, (int)centers[i].y, Color::White);
+                batch.DrawCircleSector(centers[i], radii[i], 0, 360, 0, Color(255, 80, 80, 255));
+            }
+        });
+        drawCalls[pass] = batch.GetFrameStats().drawCalls;
+    }
+    batch.SetShapeSdf(true);
+
+    Log(0, "HEADLESS: sprites and circles %i   %llu draw calls tessellated, %llu with SDF quads", 1000, drawCalls[0], drawCalls[1]);
+    if (drawCalls[1] != 1)
+    {
+        Log(2, "HEADLESS: sprites and circles: %llu draw calls with SDF quads, expected 1", drawCalls[1]);
+        failures++;
+    }
+
+    batch.ResetFrameStats();
+    return failures;
+}
+
+// NOTE: Exits with 1 when the batch stats and the recorded draw calls disagree
+int RunHeadless(int count, int frames)
+{
+    InitHeadless();
+    srand(1);
+    jobs.Create();
+
+    std::vector<Bunny> bunnies(count);
+    std::vector<SpriteInstance> sprites;
+
+    std::vector<BatchRecorder> recorders;
+    const char *names[] = { "quads", "instanced", "bulk", "4 textures", "4 textures multi", "4 atlas sprites", "mixed atlas", "parallel", "transformed" };
+    const int scenarios = sizeof(names)/sizeof(names[0]);
+    int failures = 0;
+    unsigned long long quadsDrawCalls = 0;
+
+    Log(0, "HEADLESS: %i sprites, %i frames", count, frames);
+    for (int scenario = 0; scenario < scenarios; scenario++)
+    {
+        batch.SetInstancing(scenario == 1);
+        batch.SetMultiTexture(scenario == 4);
+        bulkSubmit = (scenario == 2);
+        mixedScene = (scenario == 6);
+        textureSet = (scenario == 3 || scenario == 4) ? 1 : ((scenario == 5 || scenario == 6) ? 3 : 0);
+        if (textureSet == 3) batch.SetShapesTexture(atlasWhite, Rectangle(0, 0, 1, 1));
+        else batch.ResetShapesTexture();
+
+        double seconds = TimePass(frames, [&bunnies, &sprites, &recorders, scenario](int)
+        {
+            // Whole scene tilted around the screen center by the matrix stack
+            if (scenario == 8)
+            {
+                batch.PushMatrix();
+                batch.Translate(SCR_WIDTH/2.0f, SCR_HEIGHT/2.0f);
+                batch.Rotate(15.0f);
+                batch.Translate(-(SCR_WIDTH/2.0f), -(SCR_HEIGHT/2.0f));
+            }
+            if (scenario == 7) SubmitParallel(bunnies, recorders);
+            else for (size_t i = 0; i < bunnies.size(); i++) bunnies[i].Update();
+            if (bulkSubmit) SubmitBulk(bunnies, sprites);
+            if (scenario == 8) batch.PopMatrix();
+        });
+
+        const RenderStats &stats = batch.GetFrameStats();
+        const GLCounters &gl = GetGLCounters();
+        Log(0, "HEADLESS: %-17s %7.2f M sprites/s %8.1f draw calls/frame %9.1f KB/frame", names[scenario],
+            (double)count*frames/seconds/1e6, (double)gl.drawCalls/frames, (double)gl.uploadBytes/1024.0/frames);
+
+        if (stats.drawCalls != gl.drawCalls)
+        {
+            Log(2, "HEADLESS: %s: batch counted %llu draw calls, backend recorded %llu", names[scenario], stats.drawCalls, gl.drawCalls);
+            failures++;
+        }
+
+        // Same sprites through the job system and recorders (or transformed): same draws as emitting them directly
+        if (scenario == 0) quadsDrawCalls = gl.drawCalls;
+        if ((scenario == 7 || scenario == 8) && gl.drawCalls != quadsDrawCalls)
+        {
+            Log(2, "HEADLESS: %s: %llu draw calls, quads emitted directly took %llu", names[scenario], gl.drawCalls, quadsDrawCalls);
+            failures++;
+        }
+    }
+
+    batch.SetInstancing(false);
+    batch.SetMultiTexture(false);
+    batch.ResetShapesTexture();
+    mixedScene = false;
+    textureSet = 0;
+    failures += CheckCulling(count, frames);
+    failures += CheckCircles(frames);
+    failures += CheckStaticBatch(frames);
+
+    ReleaseHeadless();
+    jobs.Release();
+    return (failures > 0) ? 1 : 0;
+}
+
+// NOTE: update + emission run on the job system, Submit() and Render() stay on this thread (the serial part)
+int RunScaling(int count, int frames)
+{
+    InitHeadless();
+
+    int cores = (int)std::thread::hardware_concurrency();
+    if (cores <= 0) cores = 1;
+    std::vector<int> counts;
+    for (int threads = 1; threads < cores; threads *= 2) counts.push_back(threads);
+    counts.push_back(cores);
+
+    std::vector<BatchRecorder> recorders;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    double baseline = 0.0;
+
+    Log(0, "SCALING: %i sprites, %i frames, %i cores", count, frames, cores);
+    for (size_t run = 0; run < counts.size(); run++)
+    {
+        jobs.Create(counts[run]);
+        Random_Seed(1);
+        mousePosition.set(SCR_WIDTH/2.0f, SCR_HEIGHT/2.0f);
+        std::vector<Bunny> bunnies(count);
+
+        double parallel = 0.0;
+        double serial = 0.0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+            SubmitParallel(bunnies, recorders);
+            Uint64 recorded = SDL_GetPerformanceCounter();
+            batch.Render();
+            batch.ResetFrameStats();
+            Uint64 end = SDL_GetPerformanceCounter();
+
+            parallel += (double)(recorded - start)/frequency;
+            serial += (double)(end - recorded)/frequency;
+        }
+
+        double total = (parallel + serial)*1000.0/frames;
+        if (run == 0) baseline = total;
+        Log(0, "SCALING: %2i threads %8.2f ms/frame (update + record + submit %7.2f, render %6.2f) %5.2fx", counts[run], total,
+            parallel*1000.0/frames, serial*1000.0/frames, baseline/total);
+    }
+
+    jobs.Release();
+    ReleaseHeadless();
+    return 0;
+}
+
+// Record + submit on this thread, then on the render thread (frame time: max of both)
+// NOTE: Exits with 1 when both runs do not send the same draws and bytes to the recording backend
+int RunPipeline(int count, int frames)
+{
+    InitHeadless();
+
+    RenderThread renderThread;
+    std::vector<BatchRecorder> recorders;
+    std::vector<SpriteInstance> sprites;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    GLCounters counters[2];
+
+    Log(0, "PIPELINE: %i sprites, %i frames, %i frames in flight", count, frames, RENDER_THREAD_FRAMES);
+    for (int run = 0; run < 2; run++)
+    {
+        Random_Seed(1);
+        mousePosition.set(SCR_WIDTH/2.0f, SCR_HEIGHT/2.0f);
+        std::vector<Bunny> bunnies(count);
+        batch.Render();
+        batch.ResetFrameStats();
+        ResetGLCommands();
+
+        double record = 0.0;
+        double submit = 0.0;
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (run == 0)
+        {
+            for (int frame = 0; frame < frames; frame++)
+            {
+                Uint64 begin = SDL_GetPerformanceCounter();
+                RecordSerial(bunnies, recorders, sprites);
+                Uint64 recorded = SDL_GetPerformanceCounter();
+                SubmitRecorders(recorders);
+                batch.Render();
+                batch.ResetFrameStats();
+                record += (double)(recorded - begin)/frequency;
+                submit += (double)(SDL_GetPerformanceCounter() - recorded)/frequency;
+            }
+        }
+        else
+        {
+            renderThread.Start(&batch, RenderThreadHooks());
+            for (int frame = 0; frame < frames; frame++)
+            {
+                FrameCommands *commands = renderThread.BeginFrame();
+                submit += commands->renderTime;
+                Uint64 begin = SDL_GetPerformanceCounter();
+                RecordSerial(bunnies, commands->recorders, sprites);
+                record += (double)(SDL_GetPerformanceCounter() - begin)/frequency;
+                renderThread.EndFrame();
+            }
+            renderThread.Stop();
+            // NOTE: renderTime of the last frames in flight is not read back, leave it as an estimate
+            submit *= (double)frames/(double)std::max(frames - RENDER_THREAD_FRAMES, 1);
+        }
+        double total = (double)(SDL_GetPerformanceCounter() - start)/frequency;
+        counters[run] = GetGLCounters();
+
+        Log(0, "PIPELINE: %-13s %8.2f ms/frame (record %7.2f, submit %7.2f)", (run == 0) ? "single thread" : "render thread",
+            total*1000.0/frames, record*1000.0/frames, submit*1000.0/frames);
+    }
+
+    ReleaseHeadless();
+
+    if (counters[0].drawCalls != counters[1].drawCalls || counters[0].uploadBytes != counters[1].uploadBytes)
+    {
+        Log(2, "PIPELINE: render thread sent %llu draw calls / %llu bytes, single thread %llu / %llu",
+            counters[1].drawCalls, counters[1].uploadBytes, counters[0].drawCalls, counters[0].uploadBytes);
+        return 1;
+    }
+    return 0;
+}
+
+// Binary PPM of R8G8B8A8 rows (alpha dropped)
+static bool SavePPM(const char *fileName, const unsigned char *pixels, int width, int height)
+{
+    FILE *file = fopen(fileName, "wb");
+    if (file == NULL) return false;
+
+    fprintf(file, "P6\n%i %i\n255\n", width, height);
+    std::vector<unsigned char> row(width*3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++) memcpy(&row[x*3], &pixels[(y*width + x)*4], 3);
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    fclose(file);
+    return true;
+}
+
+// NOTE: Every thread count and the SIMD spans must give the scalar single thread image byte for byte (exit 1 if not)
+int RunSoftware(int count, int frames)
+{
+    InitHeadless();
+
+    const char *names[] = { "quads", "instanced", "4 layers", "4 textures multi", "mixed atlas" };
+    const int scenarios = sizeof(names)/sizeof(names[0]);
+    int cores = (int)std::thread::hardware_concurrency();
+    int threadCounts[] = { 1, 2, 4, (cores > 4) ? cores : 0 };
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    std::vector<unsigned char> reference;
+    SoftRasterizer raster;
+    int failures = 0;
+
+    Log(0, "SOFTRASTER: %i sprites, %i frames, %i cores", count, frames, cores);
+    for (int scenario = 0; scenario < scenarios; scenario++)
+    {
+        batch.SetInstancing(scenario == 1);
+        batch.SetMultiTexture(scenario == 3);
+        mixedScene = (scenario == 4);
+        textureSet = (scenario == 2) ? 2 : ((scenario == 3) ? 1 : ((scenario == 4) ? 3 : 0));
+        if (textureSet == 3) batch.SetShapesTexture(atlasWhite, Rectangle(0, 0, 1, 1));
+        else batch.ResetShapesTexture();
+
+        double single = 0.0;
+        for (int run = -1; run < 4; run++)
+        {
+            // Run -1: scalar spans on one thread, the reference image
+            int threads = (run < 0) ? 1 : threadCounts[run];
+            if (threads == 0) continue;
+            raster.Create(SCR_WIDTH, SCR_HEIGHT, threads);
+            raster.SetSimd(run >= 0);
+            batch.SetRasterizer(&raster);
+
+            Random_Seed(1);
+            mousePosition.set(SCR_WIDTH/2.0f, SCR_HEIGHT/2.0f);
+            std::vector<Bunny> bunnies(count);
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (int frame = 0; frame < frames; frame++)
+            {
+                raster.Clear(Color(30, 30, 40, 255));
+                for (size_t i = 0; i < bunnies.size(); i++) bunnies[i].Update();
+                batch.Render();
+                raster.Finish();
+            }
+            double seconds = (double)(SDL_GetPerformanceCounter() - start)/frequency;
+            batch.SetRasterizer(NULL);
+
+            const unsigned char *pixels = raster.GetPixels();
+            size_t bytes = (size_t)SCR_WIDTH*SCR_HEIGHT*4;
+            if (run < 0)
+            {
+                reference.assign(pixels, pixels + bytes);
+                if (scenario == 0) SavePPM("software.ppm", pixels, SCR_WIDTH, SCR_HEIGHT);
+                Log(0, "SOFTRASTER: %-17s scalar   1 thread  %8.2f ms/frame", names[scenario], seconds*1000.0/frames);
+                continue;
+            }
+
+            if (run == 0) single = seconds;
+            Log(0, "SOFTRASTER: %-17s SIMD   %2i threads %8.2f ms/frame %5.2fx", names[scenario], threads, seconds*1000.0/frames, single/seconds);
+            if (memcmp(pixels, reference.data(), bytes) != 0)
+            {
+                Log(2, "SOFTRASTER: %s: %i threads image differs from the reference", names[scenario], threads);
+                failures++;
+            }
+        }
+    }
+
+    raster.Release();
+    ReleaseHeadless();
+    return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Command line runs of the bunnymark on the recording GL backend (no window, no GPU), see main()
+// NOTE: Each returns the process exit code, 1 when one of its checks failed
+
+// CPU only run: sprites per second and draw calls of each path, then the culling, circle and static batch checks
+int RunHeadless(int count, int frames);
+
+// Core scaling of the parallel bunnymark frame, 1 to N threads
+int RunScaling(int count, int frames);
+
+// Frame time with the submission on this thread and on the render thread, both must send the same draws
+int RunPipeline(int count, int frames);
+
+// Bunnymark frames drawn by the software rasterizer, every thread count and SIMD span must give the reference image
+int RunSoftware(int count, int frames);
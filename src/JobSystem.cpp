@@ -0,0 +1,258 @@
+#include "JobSystem.hpp"
+#include "utils.hpp"
+#include <algorithm>
+
+static thread_local int workerIndex = -1;
+static thread_local unsigned int stealSeed = 0;
+
+
+JobSystem::JobDeque::JobDeque()
+{
+    top = 0;
+    bottom = 0;
+    for (int i = 0; i < JOB_DEQUE_SIZE; i++) jobs[i] = NULL;
+}
+
+bool JobSystem::JobDeque::Push(Job *job)
+{
+    long long b = bottom.load(std::memory_order_relaxed);
+    long long t = top.load(std::memory_order_acquire);
+    if (b - t >= JOB_DEQUE_SIZE) return false;
+
+    jobs[b & (JOB_DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+// NOTE: The last job is raced for with the thieves through top, whoever moves it first gets it
+Job *JobSystem::JobDeque::Pop()
+{
+    long long b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long long t = top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    Job *job = jobs[b & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = NULL;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job *JobSystem::JobDeque::Steal()
+{
+    long long t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long long b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return NULL;
+
+    Job *job = jobs[t & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return NULL;
+    return job;
+}
+
+
+JobSystem::JobSystem()
+{
+    threadCount = 0;
+    queued = 0;
+    sleeping = 0;
+    quit = false;
+}
+
+JobSystem::~JobSystem()
+{
+    Release();
+}
+
+bool JobSystem::Create(int threadCount)
+{
+    Release();
+
+    if (threadCount <= 0) threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount <= 0) threadCount = 1;
+
+    this->threadCount = threadCount;
+    quit = false;
+    for (int i = 0; i < threadCount; i++) deques.push_back(new JobDeque());
+
+    workerIndex = 0;
+    stealSeed = 1;
+    for (int i = 1; i < threadCount; i++) workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+
+    Log(0, "JOBS: %i threads", threadCount);
+    return true;
+}
+
+void JobSystem::Release()
+{
+    if (deques.empty()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    workers.clear();
+
+    for (size_t i = 0; i < deques.size(); i++) delete deques[i];
+    deques.clear();
+    threadCount = 0;
+    workerIndex = -1;
+}
+
+int JobSystem::GetWorkerIndex()
+{
+    return workerIndex;
+}
+
+
+void JobSystem::Run(const std::function<void()> &function, JobCounter *counter, JobCounter *dependency)
+{
+    Job *job = new Job();
+    job->function = function;
+    job->counter = counter;
+    if (counter != NULL) counter->pending.fetch_add(1);
+
+    // Parked on the dependency, its last job pushes it (see Finish())
+    if (dependency != NULL)
+    {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (!dependency->IsDone())
+        {
+            dependency->waiting.push_back(job);
+            return;
+        }
+    }
+    Push(job);
+}
+
+void JobSystem::ParallelFor(int count, int grain, const std::function<void(int, int)> &function, JobCounter *counter, JobCounter *dependency)
+{
+    if (count <= 0) return;
+    if (grain <= 0) grain = std::max(1, count/(std::max(threadCount, 1)*JOB_SPLIT_FACTOR));
+
+    for (int begin = 0; begin < count; begin += grain)
+    {
+        int end = std::min(begin + grain, count);
+        Run([function, begin, end]() { function(begin, end); }, counter, dependency);
+    }
+}
+
+void JobSystem::ParallelFor(int count, int grain, const std::function<void(int, int)> &function)
+{
+    JobCounter counter;
+    ParallelFor(count, grain, function, &counter);
+    Wait(counter);
+}
+
+void JobSystem::Wait(JobCounter &counter)
+{
+    while (!counter.IsDone())
+    {
+        Job *job = Take();
+        if (job != NULL) Execute(job);
+        else std::this_thread::yield();
+    }
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+
+void JobSystem::Push(Job *job)
+{
+    if (workerIndex < 0 || workerIndex >= (int)deques.size() || !deques[workerIndex]->Push(job))
+    {
+        Execute(job);
+        return;
+    }
+
+    // NOTE: queued before sleeping, a worker going to sleep checks them in the other order (no lost wake up)
+    queued.fetch_add(1);
+    if (sleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_one();
+    }
+}
+
+// Own deque first, then the others from a random one
+Job *JobSystem::Take()
+{
+    if (workerIndex < 0 || workerIndex >= (int)deques.size()) return NULL;
+
+    Job *job = deques[workerIndex]->Pop();
+    if (job == NULL)
+    {
+        int count = (int)deques.size();
+        stealSeed = stealSeed*1103515245u + 12345u;
+        int start = (int)((stealSeed >> 16) % (unsigned int)count);
+        for (int i = 0; i < count && job == NULL; i++)
+        {
+            int victim = (start + i) % count;
+            if (victim != workerIndex) job = deques[victim]->Steal();
+        }
+    }
+    if (job != NULL) queued.fetch_sub(1);
+    return job;
+}
+
+void JobSystem::Execute(Job *job)
+{
+    job->function();
+    Finish(job->counter);
+    delete job;
+}
+
+// NOTE: Counted under the lock, Wait() takes it once done, so the counter is never touched after Wait() returns
+void JobSystem::Finish(JobCounter *counter)
+{
+    if (counter == NULL) return;
+
+    std::vector<Job *> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (counter->pending.fetch_sub(1) == 1) ready.swap(counter->waiting);
+    }
+    for (size_t i = 0; i < ready.size(); i++) Push(ready[i]);
+}
+
+void JobSystem::WorkerLoop(int index)
+{
+    workerIndex = index;
+    stealSeed = (unsigned int)index*2654435761u + 1;
+
+    int spins = 0;
+    while (true)
+    {
+        Job *job = Take();
+        if (job != NULL)
+        {
+            Execute(job);
+            spins = 0;
+            continue;
+        }
+        if (++spins < JOB_SPIN_COUNT)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        spins = 0;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (quit) break;
+        sleeping.fetch_add(1);
+        wake.wait(lock, [this]() { return quit || queued.load() > 0; });
+        sleeping.fetch_sub(1);
+        if (quit) break;
+    }
+}
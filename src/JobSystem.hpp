@@ -0,0 +1,92 @@
+#pragma once
+
+#include "pch.hpp"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#define JOB_DEQUE_SIZE           4096     // Jobs queued per thread (power of two), a full deque runs new jobs inline
+#define JOB_SPLIT_FACTOR            4     // ParallelFor() default: this many ranges per thread, for stealing to balance
+#define JOB_SPIN_COUNT            256     // Failed steal rounds before an idle worker sleeps
+
+struct JobSystem;
+struct Job;
+
+// Pending job count: Wait() on it, or make jobs depend on it (they start once it drops to zero)
+// NOTE: Jobs hold a pointer to it, keep it alive until Wait() on it returns
+struct JobCounter
+{
+    JobCounter() { pending = 0; }
+
+    bool IsDone() const { return pending.load() == 0; }
+
+private:
+    friend struct JobSystem;
+
+    std::atomic<int> pending;
+    std::mutex mutex;
+    std::vector<Job *> waiting;     // Jobs depending on this counter
+};
+
+struct Job
+{
+    std::function<void()> function;
+    JobCounter *counter;        // Decremented when the job is done (NULL: none)
+};
+
+// Work stealing scheduler: one deque per thread (the calling thread is worker 0), idle threads steal the oldest jobs
+// NOTE: Owners push and pop at the bottom (newest first, cache warm), thieves take from the top (Chase-Lev deques)
+// NOTE: Run() and Wait() from the thread that called Create() or from inside jobs, other threads run the job inline
+// NOTE: Worker indices are per thread, so one JobSystem at a time
+struct JobSystem
+{
+    JobSystem();
+    ~JobSystem();
+
+    bool Create(int threadCount = 0);       // Total threads including the caller, 0: one per core
+    void Release();                         // Waits for the workers, call it with no job left
+
+    // Queue function, counted in counter; with a dependency it starts once dependency is done
+    void Run(const std::function<void()> &function, JobCounter *counter = NULL, JobCounter *dependency = NULL);
+
+    // function(begin, end) on ranges of [0, count) of grain items (0: JOB_SPLIT_FACTOR ranges per thread)
+    void ParallelFor(int count, int grain, const std::function<void(int, int)> &function, JobCounter *counter, JobCounter *dependency = NULL);
+    void ParallelFor(int count, int grain, const std::function<void(int, int)> &function);     // Returns when all ranges are done
+
+    void Wait(JobCounter &counter);         // Runs jobs on this thread until the counter is done
+
+    int GetThreadCount() const { return threadCount; }
+    static int GetWorkerIndex();            // 0 for the creating thread, -1 outside the system
+
+private:
+    struct JobDeque
+    {
+        JobDeque();
+
+        bool Push(Job *job);        // Owner only
+        Job *Pop();                 // Owner only
+        Job *Steal();               // Any thread
+
+        std::atomic<long long> top;
+        char padding[64];           // Thieves write top, the owner bottom: keep them off one cache line
+        std::atomic<long long> bottom;
+        std::atomic<Job *> jobs[JOB_DEQUE_SIZE];
+    };
+
+    void Push(Job *job);
+    Job *Take();
+    void Execute(Job *job);
+    void Finish(JobCounter *counter);
+    void WorkerLoop(int index);
+
+    int threadCount;
+    std::vector<JobDeque *> deques;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<int> queued;        // Jobs sitting in the deques, idle workers sleep while it is zero
+    std::atomic<int> sleeping;
+    bool quit;
+};
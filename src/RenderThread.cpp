@@ -0,0 +1,121 @@
+#include "RenderThread.hpp"
+#include "utils.hpp"
+
+
+RenderThread::RenderThread()
+{
+    batch = NULL;
+    written = 0;
+    rendered = 0;
+    stopping = false;
+    sleeping = 0;
+    waitTime = 0.0;
+}
+
+RenderThread::~RenderThread()
+{
+    Stop();
+}
+
+bool RenderThread::Start(RenderBatch *batch, const RenderThreadHooks &hooks)
+{
+    if (IsRunning() || batch == NULL) return false;
+
+    this->batch = batch;
+    this->hooks = hooks;
+    written = 0;
+    rendered = 0;
+    stopping = false;
+    waitTime = 0.0;
+    thread = std::thread(&RenderThread::ThreadLoop, this);
+
+    Log(0, "RENDER: Render thread started, %i frames in flight", RENDER_THREAD_FRAMES);
+    return true;
+}
+
+void RenderThread::Stop()
+{
+    if (!IsRunning()) return;
+
+    stopping = true;
+    Signal();
+    thread.join();
+    batch = NULL;
+}
+
+FrameCommands *RenderThread::BeginFrame()
+{
+    if (!IsRunning()) return NULL;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    unsigned int frame = written.load();
+    WaitFor([this, frame]() { return frame - rendered.load() < RENDER_THREAD_FRAMES; });
+    waitTime += (double)(SDL_GetPerformanceCounter() - start)/(double)SDL_GetPerformanceFrequency();
+
+    return &frames[frame % RENDER_THREAD_FRAMES];
+}
+
+void RenderThread::EndFrame()
+{
+    if (!IsRunning()) return;
+
+    written.fetch_add(1);
+    Signal();
+}
+
+
+// Spin first (the other thread is usually close), sleep after that
+// NOTE: sleeping is raised before ready() is checked under the lock, Signal() reads it after its store (no lost wake up)
+void RenderThread::WaitFor(const std::function<bool()> &ready)
+{
+    for (int i = 0; i < RENDER_THREAD_SPIN_COUNT; i++)
+    {
+        if (ready()) return;
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    sleeping.fetch_add(1);
+    wake.wait(lock, ready);
+    sleeping.fetch_sub(1);
+}
+
+void RenderThread::Signal()
+{
+    if (sleeping.load() == 0) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    wake.notify_all();
+}
+
+void RenderThread::ThreadLoop()
+{
+    if (hooks.start) hooks.start();
+
+    std::vector<const BatchRecorder *> list;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    while (true)
+    {
+        unsigned int frame = rendered.load();
+        WaitFor([this, frame]() { return stopping.load() || written.load() != frame; });
+        if (written.load() == frame) break;       // Stopping, nothing queued
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        FrameCommands &commands = frames[frame % RENDER_THREAD_FRAMES];
+        list.resize(commands.recorders.size());
+        for (size_t i = 0; i < list.size(); i++) list[i] = &commands.recorders[i];
+
+        if (hooks.beginFrame) hooks.beginFrame();
+        batch->Submit(list.data(), (int)list.size());
+        batch->Render();
+        commands.stats = batch->GetFrameStats();
+        batch->ResetFrameStats();
+        if (hooks.endFrame) hooks.endFrame();
+        commands.renderTime = (double)(SDL_GetPerformanceCounter() - start)/frequency;
+
+        rendered.store(frame + 1);
+        Signal();
+    }
+
+    if (hooks.stop) hooks.stop();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Batch.hpp"
+#include "BatchRecorder.hpp"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#define RENDER_THREAD_FRAMES        2     // Frames in flight between the threads: 2 double, 3 triple buffered
+#define RENDER_THREAD_SPIN_COUNT  256     // Yields before a waiting thread sleeps
+
+// One frame of commands handed to the render thread
+struct FrameCommands
+{
+    FrameCommands() { renderTime = 0.0; }
+
+    std::vector<BatchRecorder> recorders;       // Filled by the game thread (or its jobs), submitted in order
+
+    // Written by the render thread for the frame that last used this slot
+    RenderStats stats;
+    double renderTime;                          // Seconds in Submit() + Render() + the frame hooks
+};
+
+// GL side of the render thread: context handling and presentation (all optional, run on the render thread)
+struct RenderThreadHooks
+{
+    std::function<void()> start;            // Make the GL context current
+    std::function<void()> beginFrame;       // Clear
+    std::function<void()> endFrame;         // Swap buffers
+    std::function<void()> stop;             // Release the GL context
+};
+
+// Pipelined rendering: the game thread records frame N+1 while this thread submits frame N with the batch
+// NOTE: Frames are passed through a ring of RENDER_THREAD_FRAMES slots indexed by two atomic counters (one writer
+//       each), no lock on the hand over. A thread only sleeps after spinning on a full (empty) ring
+// NOTE: The batch and the GL context belong to the render thread between Start() and Stop(), the game thread
+//       only writes FrameCommands slots
+struct RenderThread
+{
+    RenderThread();
+    ~RenderThread();
+
+    bool Start(RenderBatch *batch, const RenderThreadHooks &hooks);
+    void Stop();                    // Renders the queued frames, then joins (stop hook done when it returns)
+    bool IsRunning() const { return thread.joinable(); }
+
+    FrameCommands *BeginFrame();    // Game thread: free slot to record into, waits while every slot is queued
+    void EndFrame();                // Game thread: queue the slot for rendering
+
+    double GetWaitTime() const { return waitTime; }    // Seconds the game thread spent in BeginFrame() since Start()
+
+private:
+    void ThreadLoop();
+    void WaitFor(const std::function<bool()> &ready);
+    void Signal();
+
+    RenderBatch *batch;
+    RenderThreadHooks hooks;
+    FrameCommands frames[RENDER_THREAD_FRAMES];
+    std::atomic<unsigned int> written;      // Frames queued by the game thread
+    std::atomic<unsigned int> rendered;     // Frames done by the render thread
+    std::atomic<bool> stopping;
+    std::atomic<int> sleeping;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+    double waitTime;
+};
@@ -0,0 +1,857 @@
+#include "SoftRaster.hpp"
+#include "utils.hpp"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define RASTER_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define RASTER_NEON
+#endif
+
+
+// Vertex decoding
+//------------------------------------------------------------------------------------------------
+static inline float HalfToFloat(unsigned short half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    float mantissa = (float)(half & 0x3ff);
+    float value;
+
+    if (exponent == 0) value = mantissa*(1.0f/16777216.0f);     // Subnormal: mantissa*2^-24
+    else if (exponent == 31) value = INFINITY;
+    else value = ldexpf(1.0f + mantissa*(1.0f/1024.0f), exponent - 15);
+
+    return (half & 0x8000) ? -value : value;
+}
+
+// mvp and viewport, as gl_Position = mvp*vec4(position, 1.0) over a width x height viewport (y from the top)
+static inline bool Project(const Matrix &m, float x, float y, float z, int width, int height, float *out)
+{
+    float cx = m.m0*x + m.m4*y + m.m8*z + m.m12;
+    float cy = m.m1*x + m.m5*y + m.m9*z + m.m13;
+    float w = m.m3*x + m.m7*y + m.m11*z + m.m15;
+    if (w <= 0.0f) return false;
+
+    out[0] = (cx/w + 1.0f)*0.5f*(float)width;
+    out[1] = (1.0f - cy/w)*0.5f*(float)height;
+    return true;
+}
+
+// Texture sampling and blending
+//------------------------------------------------------------------------------------------------
+// floorf() without the libm call, the texcoords stay far from the int range
+static inline int FastFloor(float value)
+{
+    int i = (int)value;
+    return (value < (float)i) ? i - 1 : i;
+}
+
+static inline int WrapCoord(int i, int size, bool repeat)
+{
+    if ((unsigned int)i < (unsigned int)size) return i;
+    if (repeat)
+    {
+        i %= size;
+        return (i < 0) ? i + size : i;
+    }
+    return (i < 0) ? 0 : ((i >= size) ? size - 1 : i);
+}
+
+// GL_NEAREST: texel floor(uv*size), missing textures are white (the default texture)
+static inline void SampleTexel(const GLTextureImage *texture, int layer, float u, float v, unsigned char *texel)
+{
+    if (texture == NULL || texture->pixels.empty())
+    {
+        memset(texel, 255, 4);
+        return;
+    }
+
+    int x = WrapCoord(FastFloor(u*(float)texture->width), texture->width, texture->repeatS);
+    int y = WrapCoord(FastFloor(v*(float)texture->height), texture->height, texture->repeatT);
+    layer = (layer < 0) ? 0 : ((layer >= texture->layers) ? texture->layers - 1 : layer);
+    memcpy(texel, &texture->pixels[(((size_t)layer*texture->height + y)*texture->width + x)*4], 4);
+}
+
+// finalColor = texelColor*fragColor, color in [0..255]
+static inline void Modulate(const unsigned char *texel, const float *color, unsigned char *out)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        float value = (float)texel[k]*color[k]*(1.0f/255.0f) + 0.5f;
+        out[k] = (value >= 255.0f) ? 255 : ((value <= 0.0f) ? 0 : (unsigned char)value);
+    }
+}
+
+// Coverage of an SDF shape pixel: ShapeCoverage() of the batch fragment shader, with the exact gradients
+// NOTE: p is the shape position at the pixel, dx/dy its change per pixel along x/y
+static float ShapeCoverage(int shape, int param, float px, float py, const float *dx, const float *dy)
+{
+    float a = (float)(shape & SHAPE_PARAM_MASK)/4095.0f;
+    float b = (float)param/65535.0f;
+    float len = sqrtf(px*px + py*py);
+    float unit = 0.5f*(sqrtf(dx[0]*dx[0] + dx[1]*dx[1]) + sqrtf(dy[0]*dy[0] + dy[1]*dy[1]));
+    float d;
+    if (shape & SHAPE_ROUNDED_RECT_BIT)
+    {
+        float qx = fabsf(px) - (1.0f - a);
+        float qy = fabsf(py) - (b - a);
+        float ox = std::max(qx, 0.0f);
+        float oy = std::max(qy, 0.0f);
+        d = (sqrtf(ox*ox + oy*oy) + std::min(std::max(qx, qy), 0.0f) - a)/unit;
+    }
+    else
+    {
+        float gx = (len > 0.0f) ? (px*dx[0] + py*dx[1])/len : 0.0f;
+        float gy = (len > 0.0f) ? (px*dy[0] + py*dy[1])/len : 0.0f;
+        d = (len - 1.0f)/std::max(sqrtf(gx*gx + gy*gy), 1e-6f);
+        if (a > 0.0f) d = std::max(d, (a - len)/unit);
+        if (b < 1.0f)
+        {
+            float cx = cosf(b*PI);
+            float cy = sinf(b*PI);
+            float my = fabsf(py);
+            float t = std::max(px*cx + my*cy, 0.0f);
+            float ex = px - cx*t;
+            float ey = my - cy*t;
+            float side = cx*my - cy*px;
+            float edge = sqrtf(ex*ex + ey*ey)*((side > 0.0f) ? 1.0f : ((side < 0.0f) ? -1.0f : 0.0f));
+            d = std::max(d, edge/unit);
+        }
+    }
+
+    float coverage = (shape & SHAPE_OUTLINE_BIT) ? 1.0f - fabsf(d) : 0.5f - d;
+    return std::max(0.0f, std::min(coverage, 1.0f));
+}
+
+// round(a*b/255) for a, b in [0..255], the same value Modulate() gives
+static inline unsigned char MulUnorm8(unsigned int a, unsigned int b)
+{
+    unsigned int t = a*b + 128;
+    return (unsigned char)((t + (t >> 8)) >> 8);
+}
+
+// src*srcAlpha + dst*(1 - srcAlpha) on every channel (alpha too), rounded: the reference for the SIMD paths
+static inline unsigned char BlendChannel(unsigned int src, unsigned int dst, unsigned int alpha)
+{
+    unsigned int t = src*alpha + dst*(255 - alpha) + 128;
+    return (unsigned char)((t + (t >> 8)) >> 8);
+}
+
+static inline void BlendPixel(unsigned char *dst, const unsigned char *src)
+{
+    unsigned int alpha = src[3];
+    if (alpha == 0) return;
+    if (alpha == 255)
+    {
+        memcpy(dst, src, 4);
+        return;
+    }
+    for (int k = 0; k < 4; k++) dst[k] = BlendChannel(src[k], dst[k], alpha);
+}
+
+#if defined(RASTER_X86)
+// Two pixels widened to 16 bit lanes
+static inline __m128i BlendSSE2(__m128i src, __m128i dst)
+{
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    __m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(src, alpha), _mm_mullo_epi16(dst, inverse)), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+#endif
+
+static void BlendSpan(unsigned char *dst, const unsigned char *src, int count, bool simd)
+{
+    int i = 0;
+#if defined(RASTER_X86)
+    if (simd)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alphaMask = _mm_set1_epi32((int)0xff000000);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i s = _mm_loadu_si128((const __m128i *)(src + i*4));
+            __m128i alpha = _mm_and_si128(s, alphaMask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xffff) continue;
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask)) == 0xffff)
+            {
+                _mm_storeu_si128((__m128i *)(dst + i*4), s);
+                continue;
+            }
+
+            __m128i d = _mm_loadu_si128((const __m128i *)(dst + i*4));
+            __m128i lo = BlendSSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            __m128i hi = BlendSSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+            _mm_storeu_si128((__m128i *)(dst + i*4), _mm_packus_epi16(lo, hi));
+        }
+    }
+#elif defined(RASTER_NEON)
+    if (simd)
+    {
+        static const unsigned char alphaIndex[8] = { 3, 3, 3, 3, 7, 7, 7, 7 };
+        const uint8x8_t index = vld1_u8(alphaIndex);
+        for (; i + 2 <= count; i += 2)
+        {
+            uint8x8_t s = vld1_u8(src + i*4);
+            uint8x8_t d = vld1_u8(dst + i*4);
+            uint8x8_t alpha = vtbl1_u8(s, index);
+            uint16x8_t t = vaddq_u16(vmlal_u8(vmull_u8(s, alpha), d, vsub_u8(vdup_n_u8(255), alpha)), vdupq_n_u16(128));
+            vst1_u8(dst + i*4, vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8));
+        }
+    }
+#endif
+    for (; i < count; i++) BlendPixel(dst + i*4, src + i*4);
+}
+
+// Texels times a constant vertex color
+static void ModulateSpan(unsigned char *span, const unsigned char *color, int count, bool simd)
+{
+    int i = 0;
+#if defined(RASTER_X86)
+    if (simd)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i half = _mm_set1_epi16(128);
+        const __m128i tint = _mm_set_epi16(color[3], color[2], color[1], color[0], color[3], color[2], color[1], color[0]);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i texels = _mm_loadu_si128((const __m128i *)(span + i*4));
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(texels, zero), tint), half);
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(texels, zero), tint), half);
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+            _mm_storeu_si128((__m128i *)(span + i*4), _mm_packus_epi16(lo, hi));
+        }
+    }
+#elif defined(RASTER_NEON)
+    if (simd)
+    {
+        const unsigned char tintBytes[8] = { color[0], color[1], color[2], color[3], color[0], color[1], color[2], color[3] };
+        const uint8x8_t tint = vld1_u8(tintBytes);
+        for (; i + 2 <= count; i += 2)
+        {
+            uint16x8_t t = vaddq_u16(vmull_u8(vld1_u8(span + i*4), tint), vdupq_n_u16(128));
+            vst1_u8(span + i*4, vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8));
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        for (int k = 0; k < 4; k++) span[i*4 + k] = MulUnorm8(span[i*4 + k], color[k]);
+    }
+}
+
+// Opaque flat spans
+static void FillSpan(unsigned char *dst, const unsigned char *color, int count, bool simd)
+{
+    int i = 0;
+#if defined(RASTER_X86)
+    if (simd)
+    {
+        int value;
+        memcpy(&value, color, 4);
+        __m128i fill = _mm_set1_epi32(value);
+        for (; i + 4 <= count; i += 4) _mm_storeu_si128((__m128i *)(dst + i*4), fill);
+    }
+#endif
+    for (; i < count; i++) memcpy(dst + i*4, color, 4);
+}
+
+
+// Rasterizer
+//------------------------------------------------------------------------------------------------
+SoftRasterizer::SoftRasterizer()
+{
+    width = 0;
+    height = 0;
+    tilesX = 0;
+    tilesY = 0;
+    culling = true;
+    simd = true;
+    generation = 0;
+    running = 0;
+    quit = false;
+    nextTile = 0;
+}
+
+SoftRasterizer::~SoftRasterizer()
+{
+    Release();
+}
+
+bool SoftRasterizer::Create(int width, int height, int threadCount)
+{
+    Release();
+    if (width <= 0 || height <= 0)
+    {
+        Log(2, "SOFTRASTER: Invalid framebuffer size %ix%i", width, height);
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+    tilesX = (width + RASTER_TILE_SIZE - 1)/RASTER_TILE_SIZE;
+    tilesY = (height + RASTER_TILE_SIZE - 1)/RASTER_TILE_SIZE;
+    pixels.assign((size_t)width*height*4, 0);
+    bins.resize(tilesX*tilesY);
+
+    if (threadCount <= 0) threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount <= 0) threadCount = 1;
+    for (int i = 1; i < threadCount; i++) workers.push_back(std::thread(&SoftRasterizer::WorkerLoop, this));
+
+    if (GetGLBackend() != GL_BACKEND_RECORDING) Log(1, "SOFTRASTER: Textures need the recording GL backend, they will sample white");
+    Log(0, "SOFTRASTER: %ix%i framebuffer, %i tiles, %i threads", width, height, tilesX*tilesY, threadCount);
+    return true;
+}
+
+void SoftRasterizer::Release()
+{
+    if (!workers.empty())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+        workers.clear();
+        quit = false;
+    }
+
+    pixels.clear();
+    primitives.clear();
+    bins.clear();
+    width = 0;
+    height = 0;
+}
+
+void SoftRasterizer::Clear(const Color &color)
+{
+    Finish();
+    for (size_t i = 0; i < pixels.size(); i += 4)
+    {
+        pixels[i + 0] = color.r;
+        pixels[i + 1] = color.g;
+        pixels[i + 2] = color.b;
+        pixels[i + 3] = color.a;
+    }
+}
+
+const unsigned char *SoftRasterizer::GetPixels()
+{
+    Finish();
+    return pixels.data();
+}
+
+// Same walk as RenderBatch::Render(): vertexOffset skips alignment padding, SPRITES read the instance array
+void SoftRasterizer::Submit(const DrawCall *draws, int drawCount, VertexLayout layout, const unsigned char *vertices, const QuadInstance *instances, const Matrix &mvp)
+{
+    if (pixels.empty()) return;
+
+    int stride = GetLayoutStride(layout);
+    const GLTextureImage *table[BATCH_MAX_TEXTURE_SLOTS];
+    RasterVertex quad[4];
+
+    for (int i = 0, vertexOffset = 0, instanceOffset = 0; i < drawCount; i++)
+    {
+        const DrawCall &draw = draws[i];
+        if (draw.vertexCount == 0) continue;
+
+        if (draw.textureCount > 1)
+        {
+            for (int k = 0; k < BATCH_MAX_TEXTURE_SLOTS; k++) table[k] = GetGLTextureImage(draw.textures[(k < draw.textureCount) ? k : 0]);
+        }
+        else
+        {
+            const GLTextureImage *texture = GetGLTextureImage(draw.textureId & ~TEXTURE_ARRAY_BIT);
+            for (int k = 0; k < BATCH_MAX_TEXTURE_SLOTS; k++) table[k] = texture;
+        }
+
+        if (draw.mode == SPRITES)
+        {
+            // The instanced vertex shader, corners in QUADS order
+            static const float corners[8] = { 0.0f, 0.0f,  0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f };
+            for (int k = 0; k < draw.vertexCount; k++)
+            {
+                const QuadInstance &instance = instances[instanceOffset + k];
+                float s = sinf(instance.rotation);
+                float c = cosf(instance.rotation);
+                bool visible = true;
+
+                for (int j = 0; j < 4; j++)
+                {
+                    float localX = corners[j*2]*instance.width - instance.originX;
+                    float localY = corners[j*2 + 1]*instance.height - instance.originY;
+                    float position[2] = { 0.0f, 0.0f };
+                    visible &= Project(mvp, instance.x + (localX*c - localY*s), instance.y + (localX*s + localY*c), 0.0f, width, height, position);
+
+                    RasterVertex &vertex = quad[j];
+                    vertex.x = position[0];
+                    vertex.y = position[1];
+                    vertex.attr[0] = instance.u0 + (instance.u1 - instance.u0)*corners[j*2];
+                    vertex.attr[1] = instance.v0 + (instance.v1 - instance.v0)*corners[j*2 + 1];
+                    vertex.attr[2] = instance.color.r;
+                    vertex.attr[3] = instance.color.g;
+                    vertex.attr[4] = instance.color.b;
+                    vertex.attr[5] = instance.color.a;
+                    vertex.layer = 0;
+                    vertex.slot = 0;
+                    vertex.shape = 0;
+                }
+                if (!visible) continue;
+
+                AddTriangle(quad[0], quad[1], quad[2], table);
+                AddTriangle(quad[0], quad[2], quad[3], table);
+            }
+            instanceOffset += draw.vertexCount;
+            continue;
+        }
+
+        int perPrimitive = (draw.mode == LINES) ? 2 : ((draw.mode == TRIANGLES) ? 3 : 4);
+        const unsigned char *data = vertices + (size_t)vertexOffset*stride;
+        for (int k = 0; k + perPrimitive <= draw.vertexCount; k += perPrimitive)
+        {
+            bool visible = true;
+            for (int j = 0; j < perPrimitive; j++, data += stride)
+            {
+                float x = 0.0f, y = 0.0f, z = 0.0f;
+                RasterVertex &vertex = quad[j];
+                vertex.layer = 0;
+                vertex.slot = 0;
+                vertex.shape = 0;
+
+                const Color *color = NULL;
+                switch (layout)
+                {
+                    case VERTEX_LAYOUT_2D:
+                    {
+                        const Vertex2D *source = (const Vertex2D *)data;
+                        x = source->x;
+                        y = source->y;
+                        vertex.attr[0] = source->u*(1.0f/65535.0f);
+                        vertex.attr[1] = source->v*(1.0f/65535.0f);
+                        color = &source->color;
+                    } break;
+                    case VERTEX_LAYOUT_2D_HALF:
+                    {
+                        const Vertex2DHalf *source = (const Vertex2DHalf *)data;
+                        x = HalfToFloat(source->x);
+                        y = HalfToFloat(source->y);
+                        vertex.attr[0] = source->u*(1.0f/65535.0f);
+                        vertex.attr[1] = source->v*(1.0f/65535.0f);
+                        color = &source->color;
+                    } break;
+                    case VERTEX_LAYOUT_2D_SHORT:
+                    {
+                        const Vertex2DShort *source = (const Vertex2DShort *)data;
+                        x = source->x;
+                        y = source->y;
+                        vertex.attr[0] = source->u*(1.0f/65535.0f);
+                        vertex.attr[1] = source->v*(1.0f/65535.0f);
+                        color = &source->color;
+                    } break;
+                    default:
+                    {
+                        const Vertex *source = (const Vertex *)data;
+                        x = source->position.x;
+                        y = source->position.y;
+                        z = source->position.z;
+                        vertex.attr[0] = source->texcoord.x;
+                        vertex.attr[1] = source->texcoord.y;
+                        vertex.layer = source->layer;
+                        vertex.slot = (source->slot < BATCH_MAX_TEXTURE_SLOTS) ? source->slot : 0;
+                        vertex.shape = (source->slot & SHAPE_SDF_BIT) ? source->slot : 0;
+                        color = &source->color;
+                    } break;
+                }
+                vertex.attr[2] = color->r;
+                vertex.attr[3] = color->g;
+                vertex.attr[4] = color->b;
+                vertex.attr[5] = color->a;
+
+                float position[2] = { 0.0f, 0.0f };
+                visible &= Project(mvp, x, y, z, width, height, position);
+                vertex.x = position[0];
+                vertex.y = position[1];
+            }
+            if (!visible) continue;
+
+            // Quad index buffer order: (0, 1, 2) (0, 2, 3)
+            if (perPrimitive == 2) AddLine(quad[0], quad[1], table);
+            else AddTriangle(quad[0], quad[1], quad[2], table);
+            if (perPrimitive == 4) AddTriangle(quad[0], quad[2], quad[3], table);
+        }
+        vertexOffset += draw.vertexCount + draw.vertexAlignment;
+    }
+}
+
+// NOTE: Flat attributes (layer, texture slot) come from the last vertex, the GL provoking vertex
+void SoftRasterizer::AddTriangle(const RasterVertex &a, const RasterVertex &b, const RasterVertex &c, const GLTextureImage *const *table)
+{
+    const RasterVertex *v[3] = { &a, &b, &c };
+    long long X[3], Y[3];
+    for (int i = 0; i < 3; i++)
+    {
+        if (v[i]->x < -RASTER_GUARD_BAND || v[i]->x > width + RASTER_GUARD_BAND || v[i]->y < -RASTER_GUARD_BAND || v[i]->y > height + RASTER_GUARD_BAND) return;
+        X[i] = llroundf(v[i]->x*(1 << RASTER_SUBPIXEL_BITS));
+        Y[i] = llroundf(v[i]->y*(1 << RASTER_SUBPIXEL_BITS));
+    }
+
+    // Negative area is counter clockwise in GL window space (y up): the front face
+    long long area = (X[1] - X[0])*(Y[2] - Y[0]) - (X[2] - X[0])*(Y[1] - Y[0]);
+    if (area == 0 || (culling && area > 0)) return;
+    if (area < 0)
+    {
+        std::swap(v[1], v[2]);
+        std::swap(X[1], X[2]);
+        std::swap(Y[1], Y[2]);
+        area = -area;
+    }
+
+    Primitive primitive;
+    float scale = 1.0f/(float)(1 << RASTER_SUBPIXEL_BITS);
+    float minX = (float)std::min(X[0], std::min(X[1], X[2]))*scale;
+    float maxX = (float)std::max(X[0], std::max(X[1], X[2]))*scale;
+    float minY = (float)std::min(Y[0], std::min(Y[1], Y[2]))*scale;
+    float maxY = (float)std::max(Y[0], std::max(Y[1], Y[2]))*scale;
+    primitive.minX = std::max(0, (int)floorf(minX));
+    primitive.maxX = std::min(width - 1, (int)ceilf(maxX));
+    primitive.minY = std::max(0, (int)floorf(minY));
+    primitive.maxY = std::min(height - 1, (int)ceilf(maxY));
+    if (primitive.minX > primitive.maxX || primitive.minY > primitive.maxY) return;
+
+    // Shared edges come in opposite directions, the tie rule takes exactly one side
+    for (int e = 0; e < 3; e++)
+    {
+        int n = (e + 1) % 3;
+        primitive.edgeA[e] = -(Y[n] - Y[e]);
+        primitive.edgeB[e] = X[n] - X[e];
+        primitive.edgeC[e] = -(primitive.edgeA[e]*X[e] + primitive.edgeB[e]*Y[e]);
+        primitive.edgeInclusive[e] = (primitive.edgeA[e] > 0) || (primitive.edgeA[e] == 0 && primitive.edgeB[e] > 0);
+        primitive.edgeInverse[e] = (primitive.edgeA[e] != 0) ? 1.0/(double)(primitive.edgeA[e] << RASTER_SUBPIXEL_BITS) : 0.0;
+    }
+
+    // Attribute planes over the snapped positions
+    float x0 = (float)X[0]*scale, y0 = (float)Y[0]*scale;
+    float e1x = (float)X[1]*scale - x0, e1y = (float)Y[1]*scale - y0;
+    float e2x = (float)X[2]*scale - x0, e2y = (float)Y[2]*scale - y0;
+    float invArea = 1.0f/(e1x*e2y - e2x*e1y);
+    for (int k = 0; k < 6; k++)
+    {
+        float d1 = v[1]->attr[k] - v[0]->attr[k];
+        float d2 = v[2]->attr[k] - v[0]->attr[k];
+        primitive.attr[k] = v[0]->attr[k];
+        primitive.attrDx[k] = (d1*e2y - d2*e1y)*invArea;
+        primitive.attrDy[k] = (d2*e1x - d1*e2x)*invArea;
+    }
+    primitive.x0 = x0;
+    primitive.y0 = y0;
+    primitive.x1 = 0.0f;
+    primitive.y1 = 0.0f;
+    primitive.line = false;
+    primitive.texture = table[c.slot];
+    primitive.layer = c.layer;
+    primitive.shape = c.shape;
+
+    bool flatColor = true, flatTexcoord = true;
+    for (int k = 0; k < 6; k++)
+    {
+        bool constant = (primitive.attrDx[k] == 0.0f && primitive.attrDy[k] == 0.0f);
+        if (k < 2) flatTexcoord &= constant;
+        else flatColor &= constant;
+    }
+    if (primitive.shape != 0)
+    {
+        primitive.flat = false;
+        primitive.tinted = false;
+    }
+    else if (!SetupColor(primitive, flatColor, flatTexcoord)) return;
+
+    primitives.push_back(primitive);
+    Bin(primitives.back());
+}
+
+void SoftRasterizer::AddLine(const RasterVertex &a, const RasterVertex &b, const GLTextureImage *const *table)
+{
+    if (a.x == b.x && a.y == b.y) return;
+    if (std::min(a.x, b.x) < -RASTER_GUARD_BAND || std::max(a.x, b.x) > width + RASTER_GUARD_BAND ||
+        std::min(a.y, b.y) < -RASTER_GUARD_BAND || std::max(a.y, b.y) > height + RASTER_GUARD_BAND) return;
+
+    Primitive primitive;
+    primitive.minX = std::max(0, (int)floorf(std::min(a.x, b.x)));
+    primitive.maxX = std::min(width - 1, (int)ceilf(std::max(a.x, b.x)));
+    primitive.minY = std::max(0, (int)floorf(std::min(a.y, b.y)));
+    primitive.maxY = std::min(height - 1, (int)ceilf(std::max(a.y, b.y)));
+    if (primitive.minX > primitive.maxX || primitive.minY > primitive.maxY) return;
+
+    primitive.line = true;
+    primitive.x0 = a.x;
+    primitive.y0 = a.y;
+    primitive.x1 = b.x;
+    primitive.y1 = b.y;
+    bool flatColor = true, flatTexcoord = true;
+    for (int k = 0; k < 6; k++)
+    {
+        primitive.attr[k] = a.attr[k];
+        primitive.attrDx[k] = b.attr[k] - a.attr[k];
+        primitive.attrDy[k] = 0.0f;
+        if (k < 2) flatTexcoord &= (primitive.attrDx[k] == 0.0f);
+        else flatColor &= (primitive.attrDx[k] == 0.0f);
+    }
+    primitive.texture = table[b.slot];
+    primitive.layer = b.layer;
+    primitive.shape = 0;
+
+    if (!SetupColor(primitive, flatColor, flatTexcoord)) return;
+
+    primitives.push_back(primitive);
+    Bin(primitives.back());
+}
+
+// Constant color and texel: one source pixel for the whole primitive, false when it is fully transparent
+bool SoftRasterizer::SetupColor(Primitive &primitive, bool flatColor, bool flatTexcoord)
+{
+    const GLTextureImage *texture = primitive.texture;
+    bool singleTexel = (texture == NULL) || texture->pixels.empty() || (texture->width == 1 && texture->height == 1);
+    primitive.flat = flatColor && (flatTexcoord || singleTexel);
+    primitive.tinted = flatColor;
+
+    unsigned char white[4] = { 255, 255, 255, 255 };
+    Modulate(white, &primitive.attr[2], primitive.tint);
+    if (!primitive.flat) return true;
+
+    unsigned char texel[4];
+    SampleTexel(texture, primitive.layer, primitive.attr[0], primitive.attr[1], texel);
+    Modulate(texel, &primitive.attr[2], primitive.flatColor);
+    return primitive.flatColor[3] != 0;
+}
+
+void SoftRasterizer::Bin(const Primitive &primitive)
+{
+    unsigned int index = (unsigned int)primitives.size() - 1;
+    for (int ty = primitive.minY/RASTER_TILE_SIZE; ty <= primitive.maxY/RASTER_TILE_SIZE; ty++)
+    {
+        for (int tx = primitive.minX/RASTER_TILE_SIZE; tx <= primitive.maxX/RASTER_TILE_SIZE; tx++) bins[ty*tilesX + tx].push_back(index);
+    }
+}
+
+void SoftRasterizer::Finish()
+{
+    if (primitives.empty()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        nextTile = 0;
+        running = (int)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    RunTiles();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return running == 0; });
+    }
+
+    primitives.clear();
+    for (size_t i = 0; i < bins.size(); i++) bins[i].clear();
+}
+
+void SoftRasterizer::WorkerLoop()
+{
+    unsigned int seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seen] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+        }
+
+        RunTiles();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--running == 0) done.notify_one();
+    }
+}
+
+// Tiles are handed out one at a time, busy tiles do not hold back the others
+void SoftRasterizer::RunTiles()
+{
+    int tileCount = tilesX*tilesY;
+    for (int tile = nextTile++; tile < tileCount; tile = nextTile++)
+    {
+        if (!bins[tile].empty()) DrawTile(tile);
+    }
+}
+
+void SoftRasterizer::DrawTile(int tile)
+{
+    int x0 = (tile % tilesX)*RASTER_TILE_SIZE;
+    int y0 = (tile/tilesX)*RASTER_TILE_SIZE;
+    int x1 = std::min(x0 + RASTER_TILE_SIZE, width);
+    int y1 = std::min(y0 + RASTER_TILE_SIZE, height);
+
+    const std::vector<unsigned int> &bin = bins[tile];
+    for (size_t i = 0; i < bin.size(); i++)
+    {
+        const Primitive &primitive = primitives[bin[i]];
+        if (primitive.line) DrawLinePixels(primitive, x0, y0, x1, y1);
+        else DrawTriangleSpans(primitive, x0, y0, x1, y1);
+    }
+}
+
+// Each row is solved for its covered span (pixel centers), then shaded into a tile wide buffer and blended
+void SoftRasterizer::DrawTriangleSpans(const Primitive &primitive, int x0, int y0, int x1, int y1)
+{
+    int rowStart = std::max(primitive.minY, y0);
+    int rowEnd = std::min(primitive.maxY, y1 - 1);
+    int columnStart = std::max(primitive.minX, x0);
+    int columnEnd = std::min(primitive.maxX, x1 - 1);
+    const long long half = 1 << (RASTER_SUBPIXEL_BITS - 1);
+    unsigned char span[RASTER_TILE_SIZE*4];
+
+    for (int py = rowStart; py <= rowEnd; py++)
+    {
+        long long centerY = ((long long)py << RASTER_SUBPIXEL_BITS) + half;
+        long long lo = columnStart;
+        long long hi = columnEnd;
+
+        // Inside: A*centerX + B*centerY + C > 0 (>= 0 on inclusive edges), centerX = px*256 + 128
+        // NOTE: The bound is estimated in double and settled with the exact integer test, no 64 bit divisions
+        for (int e = 0; e < 3 && lo <= hi; e++)
+        {
+            long long step = primitive.edgeA[e] << RASTER_SUBPIXEL_BITS;
+            long long rest = primitive.edgeB[e]*centerY + primitive.edgeC[e] + primitive.edgeA[e]*half - (primitive.edgeInclusive[e] ? 0 : 1);
+            if (step > 0)
+            {
+                long long first = (long long)ceil(-(double)rest*primitive.edgeInverse[e]);
+                while (step*(first - 1) + rest >= 0) first--;
+                while (step*first + rest < 0) first++;
+                lo = std::max(lo, first);
+            }
+            else if (step < 0)
+            {
+                long long last = (long long)floor(-(double)rest*primitive.edgeInverse[e]);
+                while (step*(last + 1) + rest >= 0) last++;
+                while (step*last + rest < 0) last--;
+                hi = std::min(hi, last);
+            }
+            else if (rest < 0) hi = lo - 1;
+        }
+        if (lo > hi) continue;
+
+        int count = (int)(hi - lo + 1);
+        unsigned char *dst = &pixels[((size_t)py*width + lo)*4];
+        if (primitive.flat)
+        {
+            if (primitive.flatColor[3] == 255) FillSpan(dst, primitive.flatColor, count, simd);
+            else
+            {
+                for (int i = 0; i < count; i++) memcpy(span + i*4, primitive.flatColor, 4);
+                BlendSpan(dst, span, count, simd);
+            }
+            continue;
+        }
+
+        float dx = (float)lo + 0.5f - primitive.x0;
+        float dy = (float)py + 0.5f - primitive.y0;
+        float value[6];
+        for (int k = 0; k < 6; k++) value[k] = primitive.attr[k] + primitive.attrDx[k]*dx + primitive.attrDy[k]*dy;
+
+        if (primitive.shape != 0)
+        {
+            unsigned char white[4] = { 255, 255, 255, 255 };
+            float dpdx[2] = { primitive.attrDx[0], primitive.attrDx[1] };
+            float dpdy[2] = { primitive.attrDy[0], primitive.attrDy[1] };
+            for (int i = 0; i < count; i++)
+            {
+                Modulate(white, &value[2], span + i*4);
+                span[i*4 + 3] = (unsigned char)(span[i*4 + 3]*ShapeCoverage(primitive.shape, primitive.layer, value[0], value[1], dpdx, dpdy) + 0.5f);
+                for (int k = 0; k < 6; k++) value[k] += primitive.attrDx[k];
+            }
+        }
+        else if (primitive.tinted)
+        {
+            // Texcoords in texels, no wrapping when the whole span stays inside the texture
+            const GLTextureImage *texture = primitive.texture;
+            float u = value[0]*(float)texture->width;
+            float v = value[1]*(float)texture->height;
+            float du = primitive.attrDx[0]*(float)texture->width;
+            float dv = primitive.attrDx[1]*(float)texture->height;
+            float uEnd = u + du*(float)(count - 1);
+            float vEnd = v + dv*(float)(count - 1);
+            if (std::min(u, uEnd) >= 0.0f && std::max(u, uEnd) < (float)texture->width && std::min(v, vEnd) >= 0.0f && std::max(v, vEnd) < (float)texture->height)
+            {
+                int layer = std::max(0, std::min(primitive.layer, texture->layers - 1));
+                const unsigned char *texels = &texture->pixels[(size_t)layer*texture->width*texture->height*4];
+                int maxX = texture->width - 1;
+                int maxY = texture->height - 1;
+                for (int i = 0; i < count; i++, u += du, v += dv)
+                {
+                    int x = std::min((int)u, maxX);
+                    int y = std::min((int)v, maxY);
+                    memcpy(span + i*4, texels + (y*texture->width + x)*4, 4);
+                }
+            }
+            else
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    SampleTexel(texture, primitive.layer, value[0], value[1], span + i*4);
+                    value[0] += primitive.attrDx[0];
+                    value[1] += primitive.attrDx[1];
+                }
+            }
+            if (primitive.tint[0] != 255 || primitive.tint[1] != 255 || primitive.tint[2] != 255 || primitive.tint[3] != 255) ModulateSpan(span, primitive.tint, count, simd);
+        }
+        else
+        {
+            for (int i = 0; i < count; i++)
+            {
+                unsigned char texel[4];
+                SampleTexel(primitive.texture, primitive.layer, value[0], value[1], texel);
+                Modulate(texel, &value[2], span + i*4);
+                for (int k = 0; k < 6; k++) value[k] += primitive.attrDx[k];
+            }
+        }
+        BlendSpan(dst, span, count, simd);
+    }
+}
+
+// One pixel per column (x major) or row (y major) whose center lies in [start, end), as 1 pixel wide GL lines
+void SoftRasterizer::DrawLinePixels(const Primitive &primitive, int x0, int y0, int x1, int y1)
+{
+    float dx = primitive.x1 - primitive.x0;
+    float dy = primitive.y1 - primitive.y0;
+    bool xMajor = fabsf(dx) >= fabsf(dy);
+    float start = xMajor ? std::min(primitive.x0, primitive.x1) : std::min(primitive.y0, primitive.y1);
+    float end = xMajor ? std::max(primitive.x0, primitive.x1) : std::max(primitive.y0, primitive.y1);
+
+    int first = std::max((int)ceilf(start - 0.5f), xMajor ? x0 : y0);
+    int last = std::min((int)ceilf(end - 0.5f) - 1, xMajor ? x1 - 1 : y1 - 1);
+    for (int major = first; major <= last; major++)
+    {
+        float t = xMajor ? ((float)major + 0.5f - primitive.x0)/dx : ((float)major + 0.5f - primitive.y0)/dy;
+        int minor = (int)floorf(xMajor ? primitive.y0 + t*dy : primitive.x0 + t*dx);
+        int px = xMajor ? major : minor;
+        int py = xMajor ? minor : major;
+        if (px < x0 || px >= x1 || py < y0 || py >= y1) continue;
+
+        unsigned char color[4];
+        if (primitive.flat) memcpy(color, primitive.flatColor, 4);
+        else
+        {
+            float value[6];
+            for (int k = 0; k < 6; k++) value[k] = primitive.attr[k] + primitive.attrDx[k]*t;
+            unsigned char texel[4];
+            SampleTexel(primitive.texture, primitive.layer, value[0], value[1], texel);
+            Modulate(texel, &value[2], color);
+        }
+        BlendPixel(&pixels[((size_t)py*width + px)*4], color);
+    }
+}
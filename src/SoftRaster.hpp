@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Batch.hpp"
+#include "GLBackend.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#define RASTER_TILE_SIZE           64     // Screen tile edge in pixels, the unit of work of the raster threads
+#define RASTER_SUBPIXEL_BITS        8     // Fixed point vertex snapping (24.8)
+#define RASTER_GUARD_BAND       16384     // Primitives reaching past this many pixels off screen are dropped (no clipping)
+
+// CPU renderer for RenderBatch output: RenderBatch::SetRasterizer() hands it the draws of each Render() instead of GL
+// NOTE: Follows the GL rules the bunnymark state uses: pixel centers, shared edges drawn once, nearest sampling with the
+//       texture wrap mode, texel*color, GL_SRC_ALPHA/GL_ONE_MINUS_SRC_ALPHA blending and back faces culled (CCW front)
+// NOTE: Textures come from the recording GL backend (GetGLTextureImage()), other ids sample white
+// NOTE: Submit() sets up and bins the primitives, Finish() rasterizes the tiles on all threads. Each tile is drawn
+//       by one thread in submission order, so the image does not depend on the thread count
+struct SoftRasterizer
+{
+    SoftRasterizer();
+    ~SoftRasterizer();
+
+    bool Create(int width, int height, int threadCount = 0);     // threadCount 0: one per core
+    void Release();
+
+    void Clear(const Color &color);
+    void Submit(const DrawCall *draws, int drawCount, VertexLayout layout, const unsigned char *vertices, const QuadInstance *instances, const Matrix &mvp);
+    void Finish();
+
+    const unsigned char *GetPixels();       // Finish() first, R8G8B8A8 rows from the top
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+    int GetThreadCount() const { return (int)workers.size() + 1; }
+
+    void SetCulling(bool enable) { culling = enable; }
+    void SetSimd(bool enable) { simd = enable; }           // Scalar span blending when off (reference, same output)
+    bool IsSimd() const { return simd; }
+
+private:
+    struct Primitive
+    {
+        long long edgeA[3];         // Triangle edges A*x + B*y + C in fixed point, inside when > 0
+        long long edgeB[3];
+        long long edgeC[3];
+        double edgeInverse[3];      // 1/(A*256), span bound estimate
+        bool edgeInclusive[3];      // Pixels exactly on the edge belong to this triangle
+        bool line;
+        bool flat;                  // Same source pixel everywhere (flatColor)
+        bool tinted;                // Same vertex color everywhere (tint), only the texels vary
+        unsigned char flatColor[4];
+        unsigned char tint[4];
+        float x0, y0;               // Attribute origin (lines: start)
+        float x1, y1;               // Lines: end
+        float attr[6];              // u, v, r, g, b, a at the origin
+        float attrDx[6];            // Per pixel gradients (lines: change from start to end)
+        float attrDy[6];
+        const GLTextureImage *texture;
+        int layer;
+        int shape;                  // SDF shape word (vertex slot), 0: plain, layer is its parameter B then
+        int minX, minY, maxX, maxY;
+    };
+
+    struct RasterVertex
+    {
+        float x, y;                 // Pixels from the top-left corner
+        float attr[6];
+        int layer;
+        int slot;
+        int shape;
+    };
+
+    void AddTriangle(const RasterVertex &a, const RasterVertex &b, const RasterVertex &c, const GLTextureImage *const *table);
+    void AddLine(const RasterVertex &a, const RasterVertex &b, const GLTextureImage *const *table);
+    bool SetupColor(Primitive &primitive, bool flatColor, bool flatTexcoord);
+    void Bin(const Primitive &primitive);
+    void RunTiles();
+    void DrawTile(int tile);
+    void DrawTriangleSpans(const Primitive &primitive, int x0, int y0, int x1, int y1);
+    void DrawLinePixels(const Primitive &primitive, int x0, int y0, int x1, int y1);
+    void WorkerLoop();
+
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    bool culling;
+    bool simd;
+    std::vector<unsigned char> pixels;
+    std::vector<Primitive> primitives;
+    std::vector<std::vector<unsigned int> > bins;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned int generation;        // Bumped by Finish() to start the workers
+    int running;
+    bool quit;
+    std::atomic<int> nextTile;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Batch.hpp"
+
+// Sprite to quad expansion used by RenderBatch::DrawSprites()
+// NOTE: Every path runs the same IEEE operations in the same order, so their output is bit-identical
+
+enum SpritePath
+{
+    SPRITE_PATH_SCALAR = 0,
+    SPRITE_PATH_SSE2,
+    SPRITE_PATH_AVX2,
+    SPRITE_PATH_NEON,
+};
+
+// Write 4 vertices per sprite (top-left, bottom-left, bottom-right, top-right), as DrawTexturePro() does
+// NOTE: Texcoords are offset + source*inv, the offset places atlas sprites in their page
+// NOTE: Texture slot is left at 0, Commit() sets it for multi-texture batching
+void TransformSprites(const SpriteInstance *sprites, int count, float invWidth, float invHeight, float offsetU, float offsetV, float depth, unsigned short layer, Vertex *out, SpritePath path);
+
+// SPRITES instances of the same sprites (flips folded into the source rect), as DrawSprites() emits them
+void SpritesToInstances(const SpriteInstance *sprites, int count, float invWidth, float invHeight, float offsetU, float offsetV, QuadInstance *out);
+
+// Matrix stack transform of emitted vertices, in place (x and y only), two vertices per step on the SIMD paths
+void TransformVertices(Vertex *vertices, int count, const Transform2D &transform, SpritePath path);
+
+// Same transform folded into instances: position moved, size and origin scaled, rotation added
+// NOTE: Conformal transforms only (see Transform2D::IsConformal())
+void TransformInstances(QuadInstance *instances, int count, const Transform2D &transform);
+
+// Conservative bounds (minX, minY, maxX, maxY) of dest moved by origin and rotated around dest.x, dest.y
+// NOTE: Rotated rects take the square around the pivot reaching past the farthest corner (no trig)
+inline void GetSpriteBounds(const Rectangle &dest, const Vector2 &origin, float rotation, float *bounds)
+{
+    if (rotation == 0.0f)
+    {
+        float x0 = dest.x - origin.x;
+        float y0 = dest.y - origin.y;
+        float x1 = x0 + dest.width;
+        float y1 = y0 + dest.height;
+        bounds[0] = (x0 < x1) ? x0 : x1;
+        bounds[1] = (y0 < y1) ? y0 : y1;
+        bounds[2] = (x0 < x1) ? x1 : x0;
+        bounds[3] = (y0 < y1) ? y1 : y0;
+        return;
+    }
+    float rx = fmaxf(fabsf(origin.x), fabsf(dest.width - origin.x));
+    float ry = fmaxf(fabsf(origin.y), fabsf(dest.height - origin.y));
+    float r = rx + ry;
+    bounds[0] = dest.x - r;
+    bounds[1] = dest.y - r;
+    bounds[2] = dest.x + r;
+    bounds[3] = dest.y + r;
+}
+
+// Drop the sprites whose GetSpriteBounds() miss cull (minX, minY, maxX, maxY), four per step on the SIMD paths
+// NOTE: out (count entries) is only written once a sprite is dropped: returns count when all are kept, else the survivors in out
+int CullSprites(const SpriteInstance *sprites, int count, const float *cull, SpriteInstance *out, SpritePath path);
+
+SpritePath GetSpritePath();             // Path used by DrawSprites(): best one supported by the CPU unless forced
+void SetSpritePath(SpritePath path);    // Force a path (tests), unsupported paths fall back to scalar
+const char *GetSpritePathName(SpritePath path);
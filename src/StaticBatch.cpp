@@ -0,0 +1,127 @@
+#include "StaticBatch.hpp"
+#include <algorithm>
+
+
+StaticSegment::StaticSegment()
+{
+    buffer.elementCount = 0;
+    buffer.vaoId = 0;
+    buffer.vboId = 0;
+    buffer.instanceVaoId = 0;
+    buffer.instanceVboId = 0;
+    buffer.fence = 0;
+    dirtyFirst = 0;
+    dirtyLast = 0;
+    dirtyInstanceFirst = 0;
+    dirtyInstanceLast = 0;
+}
+
+
+StaticBatch::StaticBatch()
+{
+    layout = VERTEX_LAYOUT_DEFAULT;
+    stride = sizeof(Vertex);
+    vertexCount = 0;
+    instanceCount = 0;
+}
+
+StaticBatch::~StaticBatch()
+{
+    Release();
+}
+
+void StaticBatch::Release()
+{
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        VertexBuffer &buffer = segments[i].buffer;
+        if (buffer.vaoId != 0) glDeleteVertexArrays(1, &buffer.vaoId);
+        if (buffer.vboId != 0) glDeleteBuffers(1, &buffer.vboId);
+        if (buffer.instanceVaoId != 0) glDeleteVertexArrays(1, &buffer.instanceVaoId);
+        if (buffer.instanceVboId != 0) glDeleteBuffers(1, &buffer.instanceVboId);
+    }
+    segments.clear();
+    vertexCount = 0;
+    instanceCount = 0;
+}
+
+int StaticBatch::GetDrawCount() const
+{
+    int count = 0;
+    for (size_t i = 0; i < segments.size(); i++) count += (int)segments[i].draws.size();
+    return count;
+}
+
+// Walk the vertex draws in capture order, index counts real vertices, offset the padded ones of the segment
+bool StaticBatch::UpdateVertices(int first, const Vertex *vertices, int count)
+{
+    if ((vertices == NULL) || (first < 0) || (count <= 0) || (first + count > vertexCount)) return false;
+
+    int last = first + count;
+    int index = 0;
+    for (size_t s = 0; s < segments.size() && index < last; s++)
+    {
+        StaticSegment &segment = segments[s];
+        int offset = 0;
+        for (size_t d = 0; d < segment.draws.size() && index < last; d++)
+        {
+            const DrawCall &draw = segment.draws[d];
+            if (draw.mode == SPRITES) continue;
+
+            int begin = std::max(first, index);
+            int end = std::min(last, index + draw.vertexCount);
+            if (begin < end)
+            {
+                int local = offset + begin - index;
+                unsigned char *dst = &segment.buffer.vertices[(size_t)local*stride];
+                for (int i = begin; i < end; i++, dst += stride)
+                {
+                    if (layout == VERTEX_LAYOUT_DEFAULT)
+                    {
+                        Vertex *vertex = (Vertex *)dst;
+                        unsigned short layer = vertex->layer;
+                        unsigned short slot = vertex->slot;
+                        *vertex = vertices[i - first];
+                        vertex->layer = layer;
+                        vertex->slot = slot;
+                    }
+                    else PackVertex(layout, dst, vertices[i - first]);
+                }
+
+                if (segment.dirtyFirst == segment.dirtyLast) segment.dirtyFirst = local;
+                segment.dirtyFirst = std::min(segment.dirtyFirst, local);
+                segment.dirtyLast = std::max(segment.dirtyLast, local + end - begin);
+            }
+            index += draw.vertexCount;
+            offset += draw.vertexCount + draw.vertexAlignment;
+        }
+    }
+    return true;
+}
+
+// Instances are contiguous in each segment, no padding
+bool StaticBatch::UpdateInstances(int first, const QuadInstance *instances, int count)
+{
+    if ((instances == NULL) || (first < 0) || (count <= 0) || (first + count > instanceCount)) return false;
+
+    int last = first + count;
+    int index = 0;
+    for (size_t s = 0; s < segments.size() && index < last; s++)
+    {
+        StaticSegment &segment = segments[s];
+        int size = (int)segment.buffer.instances.size();
+        int begin = std::max(first, index);
+        int end = std::min(last, index + size);
+        if (begin < end)
+        {
+            int local = begin - index;
+            std::copy(instances + (begin - first), instances + (end - first), segment.buffer.instances.begin() + local);
+
+            if (segment.dirtyInstanceFirst == segment.dirtyInstanceLast) segment.dirtyInstanceFirst = local;
+            segment.dirtyInstanceFirst = std::min(segment.dirtyInstanceFirst, local);
+            segment.dirtyInstanceLast = std::max(segment.dirtyInstanceLast, local + end - begin);
+        }
+        index += size;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Batch.hpp"
+
+// One batch buffer worth of captured draws (the batch flushed there while capturing)
+struct StaticSegment
+{
+    StaticSegment();
+
+    VertexBuffer buffer;            // CPU copy (edits, rasterizer) + GL_STATIC_DRAW objects, elementCount and fence unused
+    std::vector<DrawCall> draws;    // Non-empty draws, vertexAlignment padding included in buffer.vertices
+    int dirtyFirst;                 // Vertices [dirtyFirst, dirtyLast) edited since the last upload
+    int dirtyLast;
+    int dirtyInstanceFirst;
+    int dirtyInstanceLast;
+};
+
+// Geometry recorded once with the Draw* API (RenderBatch::BeginStatic()/EndStatic()), replayed with RenderBatch::DrawStatic()
+// NOTE: Drawn with the quad indices of the batch that captured it, keep both alive together (same GL context)
+// NOTE: Owns GL objects, copies are not allowed
+struct StaticBatch
+{
+    StaticBatch();
+    ~StaticBatch();
+
+    void Release();
+
+    // Overwrite captured vertices/instances in capture order (vertexAlignment padding skipped), uploaded on the next DrawStatic()
+    // NOTE: Layer and slot of VERTEX_LAYOUT_DEFAULT vertices are kept, shapes take the texcoords given here
+    bool UpdateVertices(int first, const Vertex *vertices, int count);
+    bool UpdateInstances(int first, const QuadInstance *instances, int count);
+
+    int GetVertexCount() const { return vertexCount; }
+    int GetInstanceCount() const { return instanceCount; }
+    int GetDrawCount() const;
+    bool IsEmpty() const { return segments.empty(); }
+
+private:
+    friend struct RenderBatch;
+
+    StaticBatch(const StaticBatch &) = delete;
+    StaticBatch &operator=(const StaticBatch &) = delete;
+
+    std::vector<StaticSegment> segments;
+    VertexLayout layout;            // Layout of the capturing batch
+    int stride;
+    int vertexCount;                // Captured, padding excluded
+    int instanceCount;
+};
@@ -2,23 +2,30 @@
 #include "pch.hpp"
 #include "utils.hpp"
 #include "Batch.hpp"
+#include "SpriteTransform.hpp"
+#include "Atlas.hpp"
+#include "GLBackend.hpp"
+#include "BatchRecorder.hpp"
+#include "JobSystem.hpp"
+#include "RenderThread.hpp"
+#include "StaticBatch.hpp"
+#include "Bunnymark.hpp"
+#include "Headless.hpp"
 
 
 
-const unsigned int SCR_WIDTH = 800;
-const unsigned int SCR_HEIGHT = 600;
-
-#define MAX_BATCH_ELEMENTS  8192
-
 SDL_Window *window;
 SDL_GLContext context;
-Texture2D texture;
-RenderBatch batch;
-Vector2 mousePosition;
 int mouseButton;
 
 
 bool m_shouldclose;
+double fps = 0.0;
+bool logStats = false;          // Log the stats and top batch breakers of the next frame
+bool parallelScene = false;     // Bunnies moved and recorded on the job system (SubmitParallel())
+bool staticBackdrop = false;    // Tile grid behind the bunnies from a static batch (single thread path only)
+StaticBatch backdrop;           // Captured on first use, released with the batch
+RenderThread renderThread;      // Running: the batch and the GL context belong to it (StartPipeline())
 void Wait(float ms)
 {
 SDL_Delay((int)ms);
@@ -54,42 +61,178 @@ void MouseUpdate()
 }
 
 
-class Bunny
+// Legacy per-vertex sprite emission (DrawTexturePro before Reserve()/Commit())
+void DrawTextureImmediate(Texture2D &texture, const Vector2 &position, const Color &tint)
+{
+    float width  = (float)texture.width;
+    float height = (float)texture.height;
+    Rectangle source ( 0.0f, 0.0f, width, height );
+    Rectangle dest (position.x, position.y, width, height );
+
+    batch.SetTexture(texture.id);
+    batch.Begin(QUADS);
+        batch.Color4ub(tint.r, tint.g, tint.b, tint.a);
+        batch.TexCoord2f(source.x/width, source.y/height);
+        batch.Vertex2f(dest.x, dest.y);
+        batch.TexCoord2f(source.x/width, (source.y + source.height)/height);
+        batch.Vertex2f(dest.x, dest.y + dest.height);
+        batch.TexCoord2f((source.x + source.width)/width, (source.y + source.height)/height);
+        batch.Vertex2f(dest.x + dest.width, dest.y + dest.height);
+        batch.TexCoord2f((source.x + source.width)/width, source.y/height);
+        batch.Vertex2f(dest.x + dest.width, dest.y);
+    batch.End();
+    batch.SetTexture(0);
+}
+
+// Micro-benchmark: CPU cost per sprite of the emitters, GPU submission is left out of the timing
+void BenchmarkEmission()
 {
-public:
-    Bunny()
+    const int rounds = 50;
+    const int sprites = MAX_BATCH_ELEMENTS - 1;     // Stay below the overflow flush
+    bool instancing = batch.IsInstancing();
+    batch.SetInstancing(false);
+    batch.Render();
+
+    std::vector<SpriteInstance> bulk(sprites);
+    for (int i = 0; i < sprites; i++)
     {
-       
-
-            position = GetMousePosition();
-            speed.x = (float)Random_Float(-250, 250)/60.0f;
-            speed.y = (float)Random_Float(-250, 250)/60.0f;
-            color = (Color){ Random_Int(50, 240),
-                                                       Random_Int(80, 240),
-                                                       Random_Int(100, 240), 255 };
-           
+        SpriteInstance &sprite = bulk[i];
+        sprite.dest = Rectangle((float)(i % SCR_WIDTH), (float)(i % SCR_HEIGHT), (float)texture.width, (float)texture.height);
+        sprite.source = Rectangle(0.0f, 0.0f, (float)texture.width, (float)texture.height);
+        sprite.rotation = 0.0f;
+        sprite.tint = Color::White;
     }
-    void Update()
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    double elapsed[2 + SPRITE_PATH_NEON + 1] = { 0.0 };
+    bool supported[2 + SPRITE_PATH_NEON + 1] = { true, true };
+    SpritePath current = GetSpritePath();
+    for (int path = 0; path < 2 + SPRITE_PATH_NEON + 1; path++)
     {
-        position.x += speed.x;
-        position.y += speed.y;
-        if (position.x > SCR_WIDTH) speed.x *= -1;
-        if (position.x < 0) speed.x *= -1;
-        if (position.y > SCR_HEIGHT) speed.y *= -1;
-        if (position.y < 0) speed.y *= -1;
+        if (path >= 2)
+        {
+            // Skip what the CPU lacks instead of timing the scalar fallback twice
+            SetSpritePath((SpritePath)(path - 2));
+            supported[path] = (GetSpritePath() == (SpritePath)(path - 2));
+            if (!supported[path]) continue;
+        }
 
+        for (int r = 0; r < rounds; r++)
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+            if (path >= 2) batch.DrawSprites(texture, bulk.data(), sprites);
+            else for (int i = 0; i < sprites; i++)
+            {
+                Vector2 position((float)(i % SCR_WIDTH), (float)(i % SCR_HEIGHT));
+                if (path == 0) DrawTextureImmediate(texture, position, Color::White);
+                else batch.DrawTextureV(texture, position, Color::White);
+            }
+            elapsed[path] += (double)(SDL_GetPerformanceCounter() - start)/frequency;
+            batch.Render();
+        }
+    }
+    SetSpritePath(current);
+
+    double count = (double)rounds*sprites;
+    Log(0, "BENCH: Vertex3f path %.1f ns/sprite, Reserve/Commit path %.1f ns/sprite (%ix%i sprites)",
+        elapsed[0]*1e9/count, elapsed[1]*1e9/count, rounds, sprites);
+    for (int path = 2; path < 2 + SPRITE_PATH_NEON + 1; path++)
+    {
+        if (supported[path]) Log(0, "BENCH: DrawSprites %s path %.1f ns/sprite", GetSpritePathName((SpritePath)(path - 2)), elapsed[path]*1e9/count);
+    }
+    batch.SetInstancing(instancing);
+}
 
-        batch.DrawTexture(texture,position.x,position.y,color);
+// Texture heavy UI mock: panels (default texture) and icons cycling through five textures
+// NOTE: Every element switches texture, so one texture per draw means one draw call per icon
+void BenchmarkTextureSlots()
+{
+    const int columns = 40;
+    const int rows = 30;
+    Texture2D *icons[5] = { &texture, &bunnyTextures[0], &bunnyTextures[1], &bunnyTextures[2], &bunnyTextures[3] };
+    bool multiTexture = batch.IsMultiTexture();
+    batch.Render();
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    int drawCalls[2] = { 0, 0 };
+    double elapsed[2] = { 0.0, 0.0 };
+    for (int pass = 0; pass < 2; pass++)
+    {
+        batch.SetMultiTexture(pass == 1);
+        if (pass == 1 && !batch.IsMultiTexture()) break;
+        batch.ResetFrameStats();
 
-        
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int y = 0; y < rows; y++)
+        {
+            for (int x = 0; x < columns; x++)
+            {
+                batch.DrawRectangle(x*20, y*20, 19, 19, Color(40, 40, 60, 255));
+                batch.DrawTexture(*icons[(y*columns + x) % 5], x*20 + 2, y*20 + 2, Color::White);
+            }
+        }
+        batch.Render();
+        glFinish();
+        elapsed[pass] = (double)(SDL_GetPerformanceCounter() - start)/frequency;
+        drawCalls[pass] = (int)batch.GetFrameStats().drawCalls;
     }
-    Vector2 position;
-    Vector2 speed;
-    Color color;
-};
+    batch.SetMultiTexture(multiTexture);
+    batch.ResetFrameStats();
+
+    Log(0, "BENCH: UI screen (%i elements) one texture per draw: %i draw calls %.2f ms, %i texture slots: %i draw calls %.2f ms",
+        rows*columns*2, drawCalls[0], elapsed[0]*1000.0, batch.GetTextureSlots(), drawCalls[1], elapsed[1]*1000.0);
+}
+
+void LogFrameStats(const RenderStats &stats)
+{
+    Log(0, "STATS: %llu draw calls, %llu vertices, %llu instances, %llu KB uploaded, %llu padding vertices, %llu culled",
+        stats.drawCalls, stats.vertices, stats.instances, stats.uploadBytes/1024, stats.paddingVertices, stats.culled);
+    Log(0, "STATS: flushes: buffer full %llu, texture %llu, mode %llu, render %llu, static %llu",
+        stats.flushes[FLUSH_BUFFER_FULL], stats.flushes[FLUSH_TEXTURE], stats.flushes[FLUSH_MODE], stats.flushes[FLUSH_RENDER], stats.flushes[FLUSH_STATIC]);
+}
+
+// Backdrop swaying with a transform: draw calls only, no vertices uploaded
+void DrawBackdrop(double time)
+{
+    if (backdrop.IsEmpty()) BuildBackdrop(backdrop, -1, Color());
+
+    batch.PushMatrix();
+    batch.Translate((float)(sin(time)*10.0), (float)(cos(time*0.7)*10.0));
+    batch.DrawStatic(backdrop);
+    batch.PopMatrix();
+}
+
+// Hand the GL context and the batch to the render thread, frames are recorded on this thread from now on
+void StartPipeline()
+{
+    if (renderThread.IsRunning()) return;
+
+    RenderThreadHooks hooks;
+    hooks.start = []() { SDL_GL_MakeCurrent(window, context); };
+    hooks.beginFrame = []()
+    {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    };
+    hooks.endFrame = []() { Swap(); };
+    hooks.stop = []() { SDL_GL_MakeCurrent(window, NULL); };
+
+    SDL_GL_MakeCurrent(window, NULL);
+    renderThread.Start(&batch, hooks);
+}
+
+// Render the queued frames and take the GL context back
+void StopPipeline()
+{
+    if (!renderThread.IsRunning()) return;
+
+    renderThread.Stop();
+    SDL_GL_MakeCurrent(window, context);
+}
 
 bool Run()
 {
+    bool resumePipeline = false;
 
 
     SDL_Event event;
@@ -110,6 +253,127 @@ bool Run()
                     m_shouldclose = true;
                     break;
                 }
+                if (event.key.keysym.sym==SDLK_h)
+                {
+                    Log(0, "BATCH: %s at %i FPS", renderThread.IsRunning() ? "render thread" : "single thread", (int)fps);
+                    if (renderThread.IsRunning()) StopPipeline();
+                    else StartPipeline();
+                    resumePipeline = false;
+                    break;
+                }
+
+                // NOTE: Settings below touch the batch (and GL), take it back from the render thread meanwhile
+                if (renderThread.IsRunning())
+                {
+                    StopPipeline();
+                    resumePipeline = true;
+                }
+                if (event.key.keysym.sym==SDLK_SPACE)
+                {
+                    Log(0, "BATCH: %s path at %i FPS", batch.IsInstancing() ? "instanced SPRITES" : "QUADS vertex", (int)fps);
+                    batch.SetInstancing(!batch.IsInstancing());
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_l)
+                {
+                    // Layout is fixed per Init(), so cycle by recreating the batch buffers
+                    VertexLayout layout = (VertexLayout)((batch.GetVertexLayout() + 1) % (VERTEX_LAYOUT_2D_SHORT + 1));
+                    Log(0, "BATCH: %i byte vertices at %i FPS", batch.GetVertexStride(), (int)fps);
+                    backdrop.Release();
+                    batch.Release();
+                    batch.Init(12, MAX_BATCH_ELEMENTS, layout);
+                    batch.setMatrix(ortho);
+                    batch.SetViewport(SCR_WIDTH, SCR_HEIGHT);
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_b)
+                {
+                    BenchmarkEmission();
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_s)
+                {
+                    Log(0, "BATCH: %s quad indices at %i FPS", batch.IsQuadStrips() ? "strip" : "triangle", (int)fps);
+                    batch.SetQuadStrips(!batch.IsQuadStrips());
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_d)
+                {
+                    Log(0, "BATCH: %s submission at %i FPS", bulkSubmit ? "DrawSprites" : "per sprite", (int)fps);
+                    bulkSubmit = !bulkSubmit;
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_p)
+                {
+                    Log(0, "BATCH: %s sprite path at %i FPS", GetSpritePathName(GetSpritePath()), (int)fps);
+                    SetSpritePath((SpritePath)((GetSpritePath() + 1) % (SPRITE_PATH_NEON + 1)));
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_o)
+                {
+                    Log(0, "BATCH: %s batching at %i FPS", batch.IsDeferred() ? "deferred" : "in order", (int)fps);
+                    batch.SetDeferred(!batch.IsDeferred());
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_r)
+                {
+                    Log(0, "BATCH: %s at %i FPS", batch.IsAutoReorder() ? "auto reorder" : "submission order", (int)fps);
+                    batch.SetAutoReorder(!batch.IsAutoReorder());
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_t)
+                {
+                    textureSet = (textureSet + 1) % 4;
+                    if (textureSet == 3) batch.SetShapesTexture(atlasWhite, Rectangle(0, 0, 1, 1));
+                    else batch.ResetShapesTexture();
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_k)
+                {
+                    Log(0, "BATCH: %i texture slots at %i FPS", batch.IsMultiTexture() ? batch.GetTextureSlots() : 1, (int)fps);
+                    batch.SetMultiTexture(!batch.IsMultiTexture());
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_u)
+                {
+                    BenchmarkTextureSlots();
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_i)
+                {
+                    logStats = true;
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_a)
+                {
+                    batch.SetBreakTracking(!batch.IsBreakTracking());
+                    Log(0, "BATCH: Break tracking %s", batch.IsBreakTracking() ? "on" : "off");
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_x)
+                {
+                    mixedScene = !mixedScene;
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_j)
+                {
+                    Log(0, "BATCH: %s bunnies at %i FPS", parallelScene ? "parallel" : "serial", (int)fps);
+                    parallelScene = !parallelScene;
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_g)
+                {
+                    staticBackdrop = !staticBackdrop;
+                    Log(0, "BATCH: Static backdrop %s", staticBackdrop ? "on" : "off");
+                    break;
+                }
+                if (event.key.keysym.sym==SDLK_m)
+                {
+                    Log(0, "BATCH: %s upload at %i FPS", batch.GetUploadMode() == UPLOAD_MAPPED ? "mapped" : "glBufferSubData", (int)fps);
+                    if (!batch.SetUploadMode(batch.GetUploadMode() == UPLOAD_MAPPED ? UPLOAD_SUBDATA : UPLOAD_MAPPED))
+                        Log(1, "BATCH: Mapped upload not available, staying on glBufferSubData");
+                    break;
+                }
         
                 break;
             }
@@ -142,13 +406,34 @@ bool Run()
             }
         }
     } 
+    if (resumePipeline && !m_shouldclose) StartPipeline();
     MouseUpdate();
     return !m_shouldclose;
 }
 
 
-int main()
+int main(int argc, char *argv[])
 {
+    // main --headless [sprites] [frames]
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+    {
+        return RunHeadless((argc > 2) ? atoi(argv[2]) : 50000, (argc > 3) ? atoi(argv[3]) : 100);
+    }
+    // main --scaling [sprites] [frames]: parallel frame time for 1..N threads
+    if (argc > 1 && strcmp(argv[1], "--scaling") == 0)
+    {
+        return RunScaling((argc > 2) ? atoi(argv[2]) : 200000, (argc > 3) ? atoi(argv[3]) : 20);
+    }
+    // main --pipeline [sprites] [frames]: frame time with and without the render thread
+    if (argc > 1 && strcmp(argv[1], "--pipeline") == 0)
+    {
+        return RunPipeline((argc > 2) ? atoi(argv[2]) : 50000, (argc > 3) ? atoi(argv[3]) : 100);
+    }
+    // main --software [sprites] [frames]: also writes the first scenario to software.ppm
+    if (argc > 1 && strcmp(argv[1], "--software") == 0)
+    {
+        return RunSoftware((argc > 2) ? atoi(argv[2]) : 10000, (argc > 3) ? atoi(argv[3]) : 20);
+    }
  
        if (SDL_Init(SDL_INIT_VIDEO) < 0) 
         {
@@ -224,7 +509,12 @@ int main()
         return false; 
     }
 
-    gladLoadGLES2Loader(SDL_GL_GetProcAddress);
+    if (!InitGLBackend(GL_BACKEND_NATIVE, (GLADloadproc)SDL_GL_GetProcAddress))
+    {
+        SDL_GL_DeleteContext(context);
+        SDL_DestroyWindow(window);
+        return 1;
+    }
     Log(0,"[DEVICE] Vendor  :  %s",glGetString(GL_VENDOR));
     Log(0,"[DEVICE] Renderer:  %s",glGetString(GL_RENDERER));
     Log(0,"[DEVICE] Version :  %s",glGetString(GL_VERSION));
@@ -257,28 +547,26 @@ int main()
 
      
      batch.Init(12, MAX_BATCH_ELEMENTS);
-     Matrix ortho;
      ortho.Ortho(0,SCR_WIDTH,SCR_HEIGHT,0,-1,1);
      
      batch.setMatrix(ortho);
+     batch.SetViewport(SCR_WIDTH, SCR_HEIGHT);
 
 
-     texture.Load("assets/wabbit_alpha.png");
+    LoadBunnyTextures();
 
     double lastTime = GetTime();
     int frameCount = 0;
 
     std::vector<Bunny> bunnies; 
-    double fps = 0.0;
+    std::vector<SpriteInstance> sprites;
+    std::vector<BatchRecorder> recorders;
+    jobs.Create();
 
     //64500 30 8 calls
 
     while(Run())
     {
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);   
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 
-
-
         //  batch.DrawLine(0,0,100,100,Color(255,0,0,255));
         //  batch.DrawRectangle(100,100,100,100,Color(0,255,0,255));
 
@@ -301,16 +589,54 @@ int main()
             }        
         }
 
-        for (int i = 0; i < bunnies.size(); i++)
+        RenderStats stats;
+        if (renderThread.IsRunning())
         {
-            bunnies[i].Update();
+            // Record this frame while the render thread submits the previous one
+            FrameCommands *frame = renderThread.BeginFrame();
+            stats = frame->stats;
+            if (logStats)
+            {
+                LogFrameStats(stats);
+                logStats = false;
+            }
+            if (parallelScene) RecordParallel(bunnies, frame->recorders);
+            else RecordSerial(bunnies, frame->recorders, sprites);
+            renderThread.EndFrame();
         }
+        else
+        {
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);   
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 
 
+            if (staticBackdrop) DrawBackdrop(GetTime());
 
+            if (parallelScene)
+            {
+                SubmitParallel(bunnies, recorders);
+            }
+            else
+            {
+                for (int i = 0; i < bunnies.size(); i++)
+                {
+                    bunnies[i].Update();
+                }
 
-        batch.Render();
+                if (bulkSubmit) SubmitBulk(bunnies, sprites);
+            }
 
+            batch.Render();
+            Swap();
 
+            stats = batch.GetFrameStats();
+            if (logStats)
+            {
+                LogFrameStats(stats);
+                batch.LogBreakReport(10);
+                logStats = false;
+            }
+            batch.ResetFrameStats();
+        }
         
 
         double currentTime = GetTime();
@@ -329,16 +655,20 @@ int main()
         }
 
 
-        Swap();
-
             int count = bunnies.size();
-            int drawCall = 1 + count /MAX_BATCH_ELEMENTS;
-            std::string title = "FPS: " + std::to_string(static_cast<int>(fps)) + " Bunnies: " + std::to_string(count) + " DrawCall: " + std::to_string(drawCall);
+            int drawCall = (int)stats.drawCalls;
+            unsigned long long bytes = stats.uploadBytes;
+            std::string title = "FPS: " + std::to_string(static_cast<int>(fps)) + " Bunnies: " + std::to_string(count) + " DrawCall: " + std::to_string(drawCall) +
+                                (batch.IsInstancing() ? " [Instanced]" : " [Quads]") + (batch.IsMultiTexture() ? " [Multi-texture]" : "") + (textureSet == 0 ? "" : (textureSet == 1 ? " [4 textures]" : (textureSet == 2 ? " [4 layers]" : " [4 atlas sprites]"))) + (batch.IsDeferred() ? " [Deferred]" : "") + (batch.IsAutoReorder() ? " [Reorder]" : "") + (mixedScene ? " [Mixed]" : "") + (parallelScene ? " [Parallel " + std::to_string(jobs.GetThreadCount()) + " threads]" : "") + (renderThread.IsRunning() ? " [Render thread]" : "") + (bulkSubmit ? " [Bulk " + std::string(GetSpritePathName(GetSpritePath())) + "]" : "") + (batch.GetUploadMode() == UPLOAD_MAPPED ? " [Mapped]" : " [SubData]") +
+                                " [" + std::to_string(batch.GetVertexStride()) + "B vertex] Upload: " + std::to_string(bytes/1024) + " KB";
             SDL_SetWindowTitle(window, title.c_str());
 
     }   
 
-    texture.Release();
+    StopPipeline();
+    ReleaseBunnyTextures();
+    jobs.Release();
+    backdrop.Release();
     
     batch.Release();
     Log(0,"[DEVICE] Close and terminate .");